@@ -0,0 +1,143 @@
+#include <algorithm>
+#include <atomic>
+#include "batch_decoder.h"
+#include "connection.h"
+
+using namespace std;
+
+/// Tarantool connector scope
+namespace tnt
+{
+
+struct batch_decoder::job
+{
+    shared_ptr<const wtf_buffer> batch;
+    vector<message_info> messages;
+    message_handler handler;
+    completion_handler on_complete;
+    size_t chunk = 1;             ///< messages claimed by a worker at once
+    size_t next = 0;              ///< the first unclaimed message (guarded by _guard)
+    atomic<size_t> done{0};       ///< handled messages
+    mutex error_guard;
+    exception_ptr error;
+};
+
+batch_decoder::batch_decoder(size_t threads)
+{
+    threads = std::max<size_t>(threads, 1);
+    _workers.reserve(threads);
+    for (size_t i = 0; i < threads; ++i)
+        _workers.emplace_back([this]() { work(); });
+}
+
+batch_decoder::~batch_decoder()
+{
+    {
+        lock_guard<mutex> lk(_guard);
+        _stop = true;
+    }
+    _has_jobs.notify_all();
+    for (auto &worker: _workers)
+        worker.join();
+}
+
+void batch_decoder::process(connection &cn, message_handler &&handler, completion_handler &&on_complete)
+{
+    auto messages = cn.input_messages();
+    process(cn.input_batch(),
+            {messages.begin(), messages.end()},
+            std::move(handler),
+            [&cn, on_complete = std::move(on_complete)](exception_ptr error) mutable
+    {
+        cn.push_handler([&cn, on_complete = std::move(on_complete), error]() mutable
+        {
+            if (on_complete)
+                on_complete(error);
+            cn.input_processed();
+        });
+    });
+}
+
+void batch_decoder::process(shared_ptr<const wtf_buffer> batch,
+                            vector<message_info> messages,
+                            message_handler &&handler,
+                            completion_handler &&on_complete)
+{
+    if (messages.empty())
+    {
+        if (on_complete)
+            on_complete(nullptr);
+        return;
+    }
+
+    auto j = make_shared<job>();
+    j->batch = std::move(batch);
+    j->messages = std::move(messages);
+    j->handler = std::move(handler);
+    j->on_complete = std::move(on_complete);
+    // small enough chunks to balance the load, big enough to keep locking rare
+    j->chunk = std::max<size_t>(j->messages.size() / (_workers.size() * 8), 1);
+    {
+        lock_guard<mutex> lk(_guard);
+        _jobs.push_back(std::move(j));
+    }
+    _has_jobs.notify_all();
+}
+
+void batch_decoder::work()
+{
+    for (;;)
+    {
+        shared_ptr<job> j;
+        size_t begin, end;
+        {
+            unique_lock<mutex> lk(_guard);
+            _has_jobs.wait(lk, [this]() { return _stop || !_jobs.empty(); });
+            if (_jobs.empty()) // stopped
+                return;
+            j = _jobs.front();
+            begin = j->next;
+            end = std::min(begin + j->chunk, j->messages.size());
+            j->next = end;
+            if (end == j->messages.size()) // the last chunk is claimed
+                _jobs.pop_front();
+        }
+
+        const char *data = j->batch->data();
+        for (size_t i = begin; i < end; ++i)
+        {
+            const message_info &info = j->messages[i];
+            try
+            {
+                j->handler(info, mp_plain{data + info.offset, data + info.offset + info.size});
+            }
+            catch (...)
+            {
+                lock_guard<mutex> lk(j->error_guard);
+                if (!j->error)
+                    j->error = current_exception();
+            }
+        }
+
+        if (j->done.fetch_add(end - begin) + (end - begin) == j->messages.size())
+        {
+            // all the messages are handled: release the batch before completion,
+            // so the connector may reuse its input buffer
+            auto on_complete = std::move(j->on_complete);
+            auto error = j->error;
+            j->batch.reset();
+            j->handler = nullptr;
+            j.reset();
+            if (on_complete)
+            {
+                try
+                {
+                    on_complete(error);
+                }
+                catch (...) {}
+            }
+        }
+    }
+}
+
+} // namespace tnt
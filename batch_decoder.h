@@ -0,0 +1,86 @@
+#ifndef BATCH_DECODER_H
+#define BATCH_DECODER_H
+
+/** @file */
+
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <thread>
+#include <vector>
+#include "fu2/function2.hpp"
+#include "iproto.h"
+#include "mp_reader.h"
+#include "wtf_buffer.h"
+
+/// Tarantool connector scope
+namespace tnt
+{
+
+class connection;
+
+/** Thread pool to decode messages of an input batch in parallel.
+ *
+ *  The batch is split at message boundaries (see connection::input_messages()),
+ *  idle workers grab the next chunk of messages until the batch is exhausted,
+ *  so the load is balanced dynamically. When all messages are handled,
+ *  the completion handler and connection::input_processed() are called within
+ *  the connector's thread (via connection::push_handler()). The connector keeps
+ *  receiving meanwhile.
+ *
+ *  \code
+ *  tnt::batch_decoder decoder;
+ *  cn.on_response([&](wtf_buffer&) {
+ *      decoder.process(cn, [](const tnt::message_info &info, mp_plain message) {
+ *          // called concurrently from worker threads
+ *      });
+ *  });
+ *  \endcode
+ */
+class batch_decoder
+{
+public:
+    /// Message handler (header and body of the message), must be thread-safe.
+    using message_handler = fu2::unique_function<void(const message_info &info, mp_plain message) const>;
+    /// Called within the connector's thread when the batch is processed,
+    /// gets the first exception thrown by the message handler (if any).
+    using completion_handler = fu2::unique_function<void(std::exception_ptr error)>;
+
+    explicit batch_decoder(size_t threads = std::thread::hardware_concurrency());
+    ~batch_decoder();
+    batch_decoder(const batch_decoder&) = delete;
+    batch_decoder& operator=(const batch_decoder&) = delete;
+
+    /// Decode current input batch of the connection and release it when finished.
+    /// Call it from within on_response() handler.
+    void process(connection &cn, message_handler &&handler, completion_handler &&on_complete = {});
+
+    /// Decode messages of an arbitrary batch, `on_complete` is called within a worker thread.
+    void process(std::shared_ptr<const wtf_buffer> batch,
+                 std::vector<message_info> messages,
+                 message_handler &&handler,
+                 completion_handler &&on_complete = {});
+
+    size_t threads() const noexcept
+    {
+        return _workers.size();
+    }
+
+private:
+    struct job;
+
+    std::vector<std::thread> _workers;
+    std::deque<std::shared_ptr<job>> _jobs;   ///< jobs having unclaimed messages
+    std::mutex _guard;
+    std::condition_variable _has_jobs;
+    bool _stop = false;
+
+    void work();
+};
+
+} // namespace tnt
+
+#endif // BATCH_DECODER_H
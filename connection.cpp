@@ -3,6 +3,7 @@
 #include <netinet/tcp.h>
 #include <sys/socket.h>
 #include <sys/un.h>
+#include "iproto_error.h"
 #include "iproto_writer.h"
 #include "msgpuck/msgpuck.h"
 #include "mp_reader.h"
@@ -87,6 +88,56 @@ void connection::process_receive_buffer()
 
         if (_detected_response_size && orphaned_bytes >= _detected_response_size)
         {
+            if (!index_message(_last_received_head_offset, _detected_response_size))
+            {
+                handle_error("incorrect iproto message header", error::unexpected_data);
+                close();
+                _autoreconnect_ticks_counter = 0; // reconnect soon
+                return;
+            }
+            if (_state == state::connected)
+            {
+                const message_info &info = _receive_index.back();
+                if (info.schema_id)
+                    _last_schema_id = info.schema_id;
+                if (_schema_caching && !_schema_loading && info.schema_id &&
+                    info.schema_id != _schema.version() && info.schema_id != _schema_failed_id)
+                    request_schema();
+                bool consumed = false;
+                if (info.code == static_cast<uint32_t>(request_type::EVENT))
+                {
+                    handle_event(info);
+                    consumed = true;
+                }
+                else if (!_internal_handlers.empty())
+                {
+                    consumed = handle_internal_response(info);
+                }
+                if (consumed)
+                {
+                    // consumed by the connector: cut the response out
+                    char *head = _receive_buffer.data() + _last_received_head_offset;
+                    size_t tail = _receive_buffer.size() - _last_received_head_offset - _detected_response_size;
+                    memmove(head, head + _detected_response_size, tail);
+                    _receive_buffer.resize(_receive_buffer.size() - _detected_response_size);
+                    _receive_index.pop_back();
+                    _detected_response_size = 0;
+                    continue;
+                }
+            }
+            if (_validate_input)
+            {
+                // header and body (if any) must fill the message exactly
+                const char *end = _receive_buffer.data() + _last_received_head_offset + _detected_response_size;
+                const char *pos = end - _detected_response_size + 5;
+                if (mp_check(&pos, end) || (pos < end && mp_check(&pos, end)) || pos != end)
+                {
+                    handle_error("invalid messagepack within iproto message", error::unexpected_data);
+                    close();
+                    _autoreconnect_ticks_counter = 0; // reconnect soon
+                    return;
+                }
+            }
             _last_received_head_offset += _detected_response_size;
             _detected_response_size = 0;
             continue;
@@ -95,6 +146,13 @@ void connection::process_receive_buffer()
     }
     while (true);
 
+    if (_events_acknowledged)
+    {
+        _events_acknowledged = false;
+        if (!_is_corked)
+            flush();
+    }
+
     // there are full responses in the buffer
     if (_last_received_head_offset)
     {
@@ -126,6 +184,20 @@ void connection::process_receive_buffer()
                     clear_receive_buffer();
                     _state = state::connected;
                     _autoreconnect_ticks_counter = -1;
+                    if (_schema_caching)
+                        request_schema();
+                    if (!_watchers.empty() && !_server_proto.has_feature(feature::WATCHERS))
+                    {
+                        handle_error("watchers are not supported by the server", error::features);
+                    }
+                    else if (!_watchers.empty())
+                    {
+                        iproto_writer w([this]() { return next_request_id(); }, _output_buffer);
+                        for (auto &watcher: _watchers)
+                            w.encode_watch_request(watcher.first);
+                        if (!_is_corked)
+                            flush();
+                    }
                     if (_connected_cb)
                     {
                         try
@@ -182,14 +254,21 @@ void connection::process_receive_buffer()
                 }
 
                 code &= 0x7fff;
-                if (_state == state::features_request && code == 0x30) // ER_UNKNOWN_REQUEST_TYPE
+                if (_state == state::features_request && code == static_cast<uint32_t>(db_error::UNKNOWN_REQUEST_TYPE))
                 {
                     if (send_auth_request())
                         return;
                     set_connected();
                     return;
                 }
-                handle_error(response.read<mp_map_reader>()[response_field::IPROTO_ERROR_24].to_string(),
+                // the message refers to the receive buffer, no copy
+                auto body = response.read<mp_map_reader>();
+                string_view message;
+                if (auto stack = body.find(response_field::IPROTO_ERROR); stack.pos())
+                    message = error_stack(stack).front().message;
+                else
+                    body[response_field::IPROTO_ERROR_24] >> message;
+                handle_error(message,
                              _state == state::features_request ? error::features : error::auth,
                              code);
             }
@@ -213,8 +292,356 @@ void connection::process_receive_buffer()
     }
 }
 
+bool connection::index_message(size_t offset, size_t size)
+{
+    constexpr size_t prefix_size = 5; // uint32 length
+    message_info info{offset + prefix_size, size - prefix_size};
+    const char *pos = _receive_buffer.data() + info.offset;
+    const char *end = pos + info.size;
+    const char *tmp = pos;
+    if (pos >= end || mp_typeof(*pos) != MP_MAP || mp_check(&tmp, end))
+        return false;
+
+    uint32_t n = mp_decode_map(&pos);
+    while (n--)
+    {
+        if (mp_typeof(*pos) != MP_UINT)
+        {
+            mp_next(&pos);
+            mp_next(&pos);
+            continue;
+        }
+        uint64_t key = mp_decode_uint(&pos);
+        if (mp_typeof(*pos) != MP_UINT)
+        {
+            mp_next(&pos);
+            continue;
+        }
+        uint64_t value = mp_decode_uint(&pos);
+        switch (key)
+        {
+        case header_field::CODE:      info.code = static_cast<uint32_t>(value); break;
+        case header_field::SYNC:      info.sync = value; break;
+        case header_field::SCHEMA_ID: info.schema_id = value; break;
+        default: break;
+        }
+    }
+    _receive_index.push_back(info);
+    return true;
+}
+
+bool connection::handle_internal_response(const message_info &info)
+{
+    auto it = _internal_handlers.find(info.sync);
+    if (it == _internal_handlers.end())
+        return false;
+    auto handler = std::move(it->second);
+    _internal_handlers.erase(it);
+    const char *head = _receive_buffer.data() + info.offset;
+    try
+    {
+        handler(info, mp_plain{head, head + info.size});
+    }
+    catch (const exception &e)
+    {
+        handle_error(e.what(), error::unexpected_data);
+    }
+    return true;
+}
+
+void connection::handle_event(const message_info &info)
+{
+    string_view key;
+    mp_plain data;
+    try
+    {
+        mp_reader msg(mp_plain{_receive_buffer.data() + info.offset, _receive_buffer.data() + info.offset + info.size});
+        msg.skip(); // header
+        auto body = msg.read<mp_map_reader>();
+        while (body.has_next())
+        {
+            switch (body.read<int>())
+            {
+            case subscription_field::EVENT_KEY:
+                body >> key;
+                break;
+            case subscription_field::EVENT_DATA:
+            {
+                const char *begin = body.pos();
+                data = {begin, body.skip().pos()};
+                break;
+            }
+            default:
+                body.skip();
+            }
+        }
+    }
+    catch (const exception &e)
+    {
+        handle_error(e.what(), error::unexpected_data);
+        return;
+    }
+
+    auto it = _watchers.find(key);
+    if (it == _watchers.end()) // unwatched meanwhile
+        return;
+
+    // the handler may (un)watch keys, so it is called out of the map
+    auto handler = std::move(it->second);
+    try
+    {
+        handler(key, data);
+    }
+    catch (const exception &e)
+    {
+        handle_error(e.what(), error::external);
+    }
+    it = _watchers.find(key);
+    if (it == _watchers.end()) // unwatched by the handler
+        return;
+    if (!it->second) // not replaced by the handler
+        it->second = std::move(handler);
+
+    // acknowledge to get the next notification
+    iproto_writer w([this]() { return next_request_id(); }, _output_buffer);
+    w.encode_watch_request(key);
+    _events_acknowledged = true;
+}
+
+connection& connection::watch(string_view key, decltype(_watchers)::mapped_type &&handler)
+{
+    auto [it, inserted] = _watchers.try_emplace(string(key));
+    it->second = std::move(handler);
+    if (inserted && _state == state::connected)
+    {
+        // a server without watchers would answer with an error of a connector's own sync
+        if (!_server_proto.has_feature(feature::WATCHERS))
+        {
+            handle_error("watchers are not supported by the server", error::features);
+            return *this;
+        }
+        iproto_writer w([this]() { return next_request_id(); }, _output_buffer);
+        w.encode_watch_request(key);
+        if (!_is_corked)
+            flush();
+    }
+    return *this;
+}
+
+void connection::unwatch(string_view key)
+{
+    auto it = _watchers.find(key);
+    if (it == _watchers.end())
+        return;
+    _watchers.erase(it);
+    if (_state == state::connected && _server_proto.has_feature(feature::WATCHERS))
+    {
+        iproto_writer w([this]() { return next_request_id(); }, _output_buffer);
+        w.encode_unwatch_request(key);
+        if (!_is_corked)
+            flush();
+    }
+}
+
+void connection::request_schema()
+{
+    _schema_loading = true;
+    // error response body (if any) as an exception
+    auto check = [](const message_info &info, mp_reader<mp_plain> &msg) {
+        if (info.code)
+        {
+            auto body = msg.read<mp_map_reader>();
+            string_view message;
+            if (auto stack = body.find(response_field::IPROTO_ERROR); stack.pos())
+                message = error_stack(stack).front().message;
+            else if (auto error = body.find(response_field::IPROTO_ERROR_24); error.pos())
+                error >> message;
+            throw runtime_error("unable to load schema: " + string(message));
+        }
+    };
+
+    iproto_writer w([this]() { return next_request_id(); }, _output_buffer);
+    w.encode_select_request(VSPACE_ID, 0, tuple<>{}, numeric_limits<uint32_t>::max(), 0, iterator_type::ALL);
+    _internal_handlers[last_request_id()] = [this, check](const message_info &info, mp_plain message)
+    {
+        _vspace_failed = true;
+        mp_reader msg(message);
+        msg.skip(); // header
+        check(info, msg);
+        auto data = msg.read<mp_map_reader>()[response_field::IPROTO_DATA];
+        _vspace_data.assign(data.pos(), data.end());
+        _vspace_schema_id = info.schema_id;
+        _vspace_failed = false;
+    };
+
+    w.encode_select_request(VINDEX_ID, 0, tuple<>{}, numeric_limits<uint32_t>::max(), 0, iterator_type::ALL);
+    _internal_handlers[last_request_id()] = [this, check](const message_info &info, mp_plain message)
+    {
+        _schema_loading = false;
+        // don't retry a failed load until the schema changes
+        _schema_failed_id = info.schema_id;
+        if (_vspace_failed) // already reported
+        {
+            _vspace_data.clear();
+            return;
+        }
+        mp_reader msg(message);
+        msg.skip(); // header
+        check(info, msg);
+        if (info.schema_id != _vspace_schema_id) // changed in between
+        {
+            _schema_failed_id = 0;
+            request_schema();
+            return;
+        }
+        auto data = msg.read<mp_map_reader>()[response_field::IPROTO_DATA];
+        _schema.load(mp_plain(_vspace_data), mp_plain{data.pos(), data.end()}, info.schema_id);
+        _vspace_data.clear();
+        _schema_failed_id = 0;
+        if (_schema_cb)
+        {
+            try
+            {
+                _schema_cb();
+            }
+            catch (const exception &e)
+            {
+                handle_error(e.what(), error::external);
+            }
+        }
+    };
+
+    if (!_is_corked)
+        flush();
+}
+
+const prepared_statement& connection::prepare_statement(iproto_writer &w, string_view sql)
+{
+    auto it = _statements.find(sql);
+    if (it == _statements.end())
+    {
+        it = _statements.try_emplace(string(sql)).first;
+        it->second.lru = _statements_lru.insert(_statements_lru.begin(), it->first);
+        while (_statements.size() > _statement_cache_size)
+        {
+            auto evicted = _statements.find(_statements_lru.back());
+            if (evicted->second.statement.id)
+                unprepare(w, evicted->second.statement.id);
+            _statements_lru.pop_back();
+            _statements.erase(evicted);
+        }
+    }
+    else
+    {
+        _statements_lru.splice(_statements_lru.begin(), _statements_lru, it->second.lru);
+    }
+
+    prepared_statement &st = it->second.statement;
+    if ((st.id || st.failed) && st.schema_id != _last_schema_id)
+    {
+        // stale after DDL, retry the failed one too
+        st.id = 0;
+        st.failed = false;
+    }
+    if (st.id || st.preparing || st.failed)
+        return st;
+
+    st.preparing = true;
+    w.encode_prepare_request(sql);
+    // the entry may be evicted meanwhile, so find it by the text
+    _internal_handlers[last_request_id()] = [this, sql = string(sql)](const message_info &info, mp_plain message)
+    {
+        auto it = _statements.find(sql);
+        if (info.code) // the execution by text gets the same error
+        {
+            if (it != _statements.end())
+            {
+                prepared_statement &st = it->second.statement;
+                st.preparing = false;
+                st.failed = true; // don't retry until schema change or reconnect
+                st.schema_id = info.schema_id;
+            }
+            return;
+        }
+
+        mp_reader msg(message);
+        msg.skip(); // header
+        auto body = msg.read<mp_map_reader>();
+        prepared_statement res;
+        while (body.has_next())
+        {
+            int key = body.read<int>();
+            auto begin = body.pos();
+            switch (key)
+            {
+            case body_field::STMT_ID:                 body >> res.id; break;
+            case response_field::IPROTO_BIND_COUNT:   body >> res.bind_count; break;
+            case response_field::IPROTO_METADATA:
+                body.skip();
+                res.metadata.assign(begin, body.pos());
+                break;
+            case response_field::IPROTO_BIND_METADATA:
+                body.skip();
+                res.bind_metadata.assign(begin, body.pos());
+                break;
+            default:
+                body.skip();
+            }
+        }
+        res.schema_id = info.schema_id;
+        if (it != _statements.end())
+        {
+            it->second.statement = std::move(res);
+        }
+        else if (res.id)
+        {
+            iproto_writer w([this]() { return next_request_id(); }, _output_buffer);
+            unprepare(w, res.id);
+            if (!_is_corked)
+                flush();
+        }
+    };
+    return st;
+}
+
+void connection::unprepare(iproto_writer &w, uint64_t stmt_id)
+{
+    w.encode_unprepare_request(stmt_id);
+    _internal_handlers[last_request_id()] = [](const message_info&, mp_plain) {};
+}
+
+const prepared_statement* connection::statement(string_view sql) const
+{
+    auto it = _statements.find(sql);
+    return it == _statements.end() ? nullptr : &it->second.statement;
+}
+
+void connection::set_statement_cache_size(size_t size)
+{
+    _statement_cache_size = std::max<size_t>(size, 1);
+    while (_statements.size() > _statement_cache_size)
+        forget_statement(_statements_lru.back());
+}
+
+void connection::forget_statement(string_view sql)
+{
+    auto it = _statements.find(sql);
+    if (it == _statements.end())
+        return;
+    if (it->second.statement.id && _state == state::connected)
+    {
+        iproto_writer w([this]() { return next_request_id(); }, _output_buffer);
+        unprepare(w, it->second.statement.id);
+        if (!_is_corked)
+            flush();
+    }
+    _statements_lru.erase(it->second.lru);
+    _statements.erase(it);
+}
+
 void connection::clear_receive_buffer()
 {
+    _receive_index.clear();
     _receive_buffer.clear();
     _last_received_head_offset = 0;
     _detected_response_size = 0;
@@ -226,13 +653,18 @@ void connection::pass_response_to_caller()
         return;
 
     size_t orphaned_bytes = _receive_buffer.size() - _last_received_head_offset;
-    _input_buffer.clear();
-    std::swap(_input_buffer, _receive_buffer);
+    if (_input_buffer.use_count() > 1) // previous batch is retained by the caller
+        _input_buffer = std::make_shared<wtf_buffer>(_input_buffer->capacity());
+    else
+        _input_buffer->clear();
+    std::swap(*_input_buffer, _receive_buffer);
+    std::swap(_input_index, _receive_index);
+    _receive_index.clear();
     if (orphaned_bytes) // partial response
     {
         _receive_buffer.resize(orphaned_bytes);
-        memcpy(_receive_buffer.data(), _input_buffer.data() + _last_received_head_offset, orphaned_bytes);
-        _input_buffer.resize(_input_buffer.size() - orphaned_bytes);
+        memcpy(_receive_buffer.data(), _input_buffer->data() + _last_received_head_offset, orphaned_bytes);
+        _input_buffer->resize(_input_buffer->size() - orphaned_bytes);
     }
     _last_received_head_offset = 0;
 
@@ -241,7 +673,7 @@ void connection::pass_response_to_caller()
         _caller_idle = false;
         try
         {
-            _response_cb(_input_buffer);
+            _response_cb(*_input_buffer);
         }
         catch (const exception &e)
         {
@@ -254,7 +686,8 @@ void connection::pass_response_to_caller()
     }
     else
     {
-        _input_buffer.clear(); // wipe data that is not going to be processed
+        _input_buffer->clear(); // wipe data that is not going to be processed
+        _input_index.clear();
     }
 }
 
@@ -463,6 +896,16 @@ void connection::close(bool call_disconnect_handler, int autoreconnect_delay) no
     _server_proto = {};
     _state = state::disconnected;
     _request_id = 0;
+    _internal_handlers.clear();
+    _schema_loading = false;
+    _schema_failed_id = 0;
+    // prepared statements are session-local
+    for (auto &st: _statements)
+    {
+        st.second.statement.id = 0;
+        st.second.statement.preparing = false;
+        st.second.statement.failed = false;
+    }
     _idle_ticks_counter = 0;
     if (autoreconnect_delay > 0)
     {
@@ -518,6 +961,11 @@ void connection::set_required_proto(proto_id proto)
     _required_proto = proto;
 }
 
+void connection::set_input_validation(bool enabled) noexcept
+{
+    _validate_input = enabled;
+}
+
 void connection::push_handler(fu2::unique_function<void()> &&handler)
 {
     unique_lock<mutex> lk(_handlers_queue_guard);
@@ -543,6 +991,35 @@ wtf_buffer& connection::output_buffer() noexcept
     return _output_buffer;
 }
 
+std::pmr::memory_resource* connection::input_resource() noexcept
+{
+    return &_input_resource;
+}
+
+std::shared_ptr<const wtf_buffer> connection::input_batch() const noexcept
+{
+    return _input_buffer;
+}
+
+void connection::set_schema_caching(bool enabled)
+{
+    _schema_caching = enabled;
+    if (!enabled)
+        _schema.clear();
+    else if (_state == state::connected && !_schema_loading)
+        request_schema();
+}
+
+const tnt::schema& connection::schema() const noexcept
+{
+    return _schema;
+}
+
+std::span<const message_info> connection::input_messages() const noexcept
+{
+    return _input_index;
+}
+
 uint64_t connection::last_request_id() const noexcept
 {
     return _request_id - 1;
@@ -553,6 +1030,11 @@ uint64_t connection::next_request_id() noexcept
     return _request_id++;
 }
 
+uint64_t connection::next_stream_id() noexcept
+{
+    return ++_stream_id;
+}
+
 const cs_parts &connection::connection_string_parts() const noexcept
 {
     return _cs_parts;
@@ -610,6 +1092,7 @@ void connection::input_processed()
 {
     // not an atomic yet.. it depends on implementation of next abstraction layer
     _caller_idle = true;
+    _input_resource.release();
     pass_response_to_caller();
 }
 
@@ -669,6 +1152,12 @@ connection& connection::on_opened(decltype(_connected_cb) &&handler)
     return *this;
 }
 
+connection& connection::on_schema_loaded(decltype(_schema_cb) &&handler)
+{
+    _schema_cb = std::move(handler);
+    return *this;
+}
+
 connection& connection::on_closed(decltype(_disconnected_cb) &&handler)
 {
     _disconnected_cb = std::move(handler);
@@ -7,11 +7,20 @@
 #include <netdb.h>
 #include <thread>
 #include <mutex>
+#include <memory>
+#include <memory_resource>
+#include <list>
+#include <span>
+#include <unordered_map>
+#include <vector>
 #include "wtf_buffer.h"
 #include "unique_socket.h"
 #include "fu2/function2.hpp"
 #include "cs_parser.h"
 #include "iproto.h"
+#include "iproto_writer.h"
+#include "schema.h"
+#include "sql.h"
 
 /// Tarantool connector scope
 namespace tnt
@@ -63,12 +72,54 @@ private:
     /** The connection must be notified when _input_buffer was processed
      *  by caller completely. An external worker must not use _input_buffer
      *  after this notification until new responces acquired via
-     *  on_response() handler. See input_processed() */
-    wtf_buffer _input_buffer;           ///< ready to process buffer
+     *  on_response() handler. See input_processed().
+     *  The caller may retain the batch (see input_batch()), then the next
+     *  batch goes to a new buffer. */
+    std::shared_ptr<wtf_buffer> _input_buffer = std::make_shared<wtf_buffer>();  ///< ready to process buffer
     wtf_buffer _receive_buffer;         ///< recv destination (partial responce permitted)
     bool _caller_idle = true;           ///< true - connector may work with _input_buffer, false - caller
     size_t _last_received_head_offset = 0;
     size_t _detected_response_size = 0; ///< current response size (to detect it's being fetched en bloc)
+    bool _validate_input = false;       ///< validate every framed message with mp_check()
+    /** Arena for data decoded from _input_buffer (released along with the buffer
+     *  within input_processed()). */
+    std::pmr::monotonic_buffer_resource _input_resource{64 * 1024};
+    std::vector<message_info> _receive_index; ///< messages framed within _receive_buffer
+    std::vector<message_info> _input_index;   ///< messages of _input_buffer
+    bool index_message(size_t offset, size_t size);
+
+    /// Handlers of the connector's own requests (by sync), their responses are not passed to the caller.
+    std::unordered_map<uint64_t, fu2::unique_function<void(const message_info &info, mp_plain message)>> _internal_handlers;
+    bool handle_internal_response(const message_info &info);
+
+    bool _schema_caching = false;
+    bool _schema_loading = false;
+    tnt::schema _schema;
+    std::vector<char> _vspace_data;     ///< _vspace data kept until _vindex response
+    uint64_t _vspace_schema_id = 0;
+    bool _vspace_failed = false;        ///< _vspace step of the current load failed
+    uint64_t _schema_failed_id = 0;     ///< schema version the last load failed at (not retried until changed)
+    void request_schema();
+
+    struct statement_entry
+    {
+        prepared_statement statement;
+        std::list<std::string_view>::iterator lru;
+    };
+    /// Prepared SQL statements by text (see execute()).
+    std::unordered_map<std::string, statement_entry, string_hash, std::equal_to<>> _statements;
+    std::list<std::string_view> _statements_lru;    ///< the most recently used first (views of _statements keys)
+    size_t _statement_cache_size = 1024;
+    uint64_t _last_schema_id = 0;       ///< the latest schema version reported by the server
+    const prepared_statement& prepare_statement(iproto_writer &w, std::string_view sql);
+    void unprepare(iproto_writer &w, uint64_t stmt_id);
+
+    /// Event handlers by key (see watch()).
+    std::unordered_map<std::string, fu2::unique_function<void(std::string_view key, mp_plain data)>,
+                       string_hash, std::equal_to<>> _watchers;
+    bool _events_acknowledged = false;  ///< WATCH acks are written while framing and wait for flush
+    void handle_event(const message_info &info);
+
     void process_receive_buffer();
     void clear_receive_buffer();
     void pass_response_to_caller();
@@ -80,6 +131,7 @@ private:
     // so no need to use offset instead of pointer.
     char *_next_to_send;
     uint64_t _request_id = 0;           ///< sync_id in terms of tnt
+    uint64_t _stream_id = 0;            ///< the last allocated stream id
     bool _is_corked = false;
     size_t _uncorked_size = 0;          ///< size of data within output buffer
     proto_id _required_proto{{feature::ERROR_EXTENSION}, 0, "chap-sha1"};
@@ -124,6 +176,7 @@ private:
     static std::function<void(connection*)> _on_construct_global_cb;
     static std::function<void(connection*)> _on_destruct_global_cb;
     fu2::unique_function<void()> _on_destruct_cb;
+    fu2::unique_function<void()> _schema_cb;
 
 public:
     connection(std::string_view connection_string = {});
@@ -134,16 +187,77 @@ public:
     void set_connection_string(std::string_view connection_string);
     /// set iproto version and features which will be requested upon subsequent connection
     void set_required_proto(proto_id proto);
+    /** Validate every received message once while framing it, so the caller
+     *  may decode responses with mp_unchecked_reader. Invalid messagepack
+     *  breaks the connection (error::unexpected_data). */
+    void set_input_validation(bool enabled) noexcept;
+    /** Load space and index catalog (_vspace, _vindex) on connect and reload it
+     *  whenever a response reports another schema version (header_field::SCHEMA_ID).
+     *  Catalog responses are consumed by the connector. See schema(). */
+    void set_schema_caching(bool enabled);
+    /// Space and index catalog (empty until loaded, see set_schema_caching()).
+    const tnt::schema& schema() const noexcept;
+    /** Put SQL EXECUTE request into the output buffer using the prepared statement cache.
+     *  The first use of the text PREPAREs it along with the execution by text,
+     *  subsequent ones execute by statement id. Statements are re-prepared
+     *  transparently after a schema change or reconnect.
+     *  \return request id (sync) of the EXECUTE request */
+    template <typename ...Ts>
+    uint64_t execute(std::string_view sql, Ts const&... args)
+    {
+        iproto_writer w([this]() { return next_request_id(); }, _output_buffer);
+        const prepared_statement &st = prepare_statement(w, sql);
+        if (st.id)
+            w.execute(st.id, args...);
+        else
+            w.execute(sql, args...);
+        return last_request_id();
+    }
+    /// Prepared statement by SQL text (with result metadata), nullptr if it was never executed or evicted.
+    const prepared_statement* statement(std::string_view sql) const;
+    /** Limit the number of cached statements. The least recently used ones
+     *  are evicted and deallocated on the server. */
+    void set_statement_cache_size(size_t size);
+    /// Drop the statement from the cache and deallocate it on the server.
+    void forget_statement(std::string_view sql);
+
+    /** Subscribe to the key (IPROTO_WATCH, feature::WATCHERS is required).
+     *  The handler is called within the connector's thread with the current value
+     *  and then on every change: `data` is EVENT_DATA right within the receive buffer
+     *  (empty if the key has no value), valid during the call only.
+     *  Notifications are acknowledged automatically, subscriptions are restored
+     *  after reconnect. Events are not passed to on_response() handler.
+     *  Nothing is sent to a server without the feature, error::features is reported instead. */
+    connection& watch(std::string_view key, decltype(_watchers)::mapped_type &&handler);
+    /// Unsubscribe from the key.
+    void unwatch(std::string_view key);
+
     /** Thread-safe method to initiate a handler call in the connector's thread */
     void push_handler(fu2::unique_function<void()> &&handler);
 
     int socket_handle() const noexcept;
     std::string_view greeting() const noexcept;
-    /** Get buffer to put requests in. A caller must take care of free space
-     * availability by calling wtf_buffer::reserve() if needed. */
+    /** Get buffer to put requests in. mp_writer/iproto_writer grow it automatically,
+     * a caller writing directly must take care of free space availability
+     * by calling wtf_buffer::reserve() if needed. */
     wtf_buffer& output_buffer() noexcept;
+    /** Memory resource to decode current responses into (e.g. std::pmr::vector<std::pmr::string>).
+     *  It is a bump-pointer arena tied to the input buffer's lifetime:
+     *  everything allocated here is freed at once within input_processed().
+     *  Not thread-safe: use it from the thread processing the input buffer. */
+    std::pmr::memory_resource* input_resource() noexcept;
+    /** Refcounted handle of the current input buffer. Zero-copy views
+     *  (mp_string_view, mp_tuple_view) holding it stay valid after
+     *  input_processed(): the retained buffer is never reused by the connector. */
+    std::shared_ptr<const wtf_buffer> input_batch() const noexcept;
+    /** Messages of the current input buffer (offsets, sync, code, schema id)
+     *  collected while framing, so the caller may dispatch them without re-scanning.
+     *  Valid until input_processed(): copy it along with a retained input_batch(). */
+    std::span<const message_info> input_messages() const noexcept;
     uint64_t last_request_id() const noexcept;
     uint64_t next_request_id() noexcept;
+    /// Allocate a new stream id (see iproto_writer::set_stream_id()).
+    uint64_t next_stream_id() noexcept;
     const cs_parts& connection_string_parts() const noexcept;
     bool is_opened() const noexcept;
     bool is_closed() const noexcept;
@@ -209,6 +323,9 @@ public:
     /** Set callback to pass reponses to. */
     connection& on_response(decltype(_response_cb) &&handler);
 
+    /** Set handler to be called when the schema catalog is (re)loaded. */
+    connection& on_schema_loaded(decltype(_schema_cb) &&handler);
+
     /**
      * Cross-thread communication helper.
      *
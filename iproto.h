@@ -32,6 +32,9 @@ enum class request_type : uint8_t
     EXECUTE    = 0x0b, // sql
     NOP        = 0x0c,
     PREPARE    = 0x0d, // sql
+    BEGIN      = 0x0e, // interactive transactions (streams)
+    COMMIT     = 0x0f,
+    ROLLBACK   = 0x10,
     PING       = 0x40,
     PROTO_ID   = 0x49, // https://www.tarantool.io/en/doc/latest/reference/internals/iproto/requests/#iproto-id
     WATCH      = 0x4a, // https://www.tarantool.io/ru/doc/latest/reference/internals/iproto/events/#iproto-watch
@@ -65,6 +68,34 @@ enum error_field
     MP_ERROR_FIELDS   = 0x06,  // MP_MAPs
 };
 
+/// Database error codes (the most frequently handled ones):
+/// https://github.com/tarantool/tarantool/blob/master/src/box/errcode.h
+enum class db_error : uint32_t
+{
+    UNKNOWN              = 0,
+    ILLEGAL_PARAMS       = 1,
+    MEMORY_ISSUE         = 2,
+    TUPLE_FOUND          = 3,   ///< duplicate key exists in unique index
+    TUPLE_NOT_FOUND      = 4,
+    UNSUPPORTED          = 5,
+    NONMASTER            = 6,
+    READONLY             = 7,
+    INJECTION            = 8,
+    INVALID_MSGPACK      = 20,
+    PROC_LUA             = 32,
+    NO_SUCH_PROC         = 33,
+    NO_SUCH_INDEX_ID     = 35,
+    NO_SUCH_SPACE        = 36,
+    ACCESS_DENIED        = 42,
+    NO_SUCH_USER         = 45,
+    PASSWORD_MISMATCH    = 47,
+    UNKNOWN_REQUEST_TYPE = 48,
+    TIMEOUT              = 78,
+    TRANSACTION_CONFLICT = 97,
+    WRONG_SCHEMA_VERSION = 109,
+    LOADING              = 116,
+};
+
 /// Request body field types (keys)
 enum body_field
 {
@@ -74,6 +105,7 @@ enum body_field
     OFFSET        = 0x13,
     ITERATOR      = 0x14,
     INDEX_BASE    = 0x15,
+    OPTIONS       = 0x2b,
     KEY           = 0x20,
     TUPLE         = 0x21,
     FUNCTION_NAME = 0x22,
@@ -85,8 +117,11 @@ enum body_field
     OPS           = 0x28,
     SQL_TEXT      = 0x40,
     SQL_BIND      = 0x41,
+    STMT_ID       = 0x43, // prepared statement id (PREPARE response, EXECUTE request)
     VERSION       = 0x54,
     FEATURES      = 0x55,
+    TIMEOUT       = 0x56, // BEGIN: transaction timeout (seconds, double)
+    TXN_ISOLATION = 0x59, // BEGIN: see txn_isolation
     AUTH_TYPE     = 0x5b,
 };
 
@@ -96,10 +131,30 @@ enum response_field
     IPROTO_DATA     = 0x30, // used in all requests and responses
     IPROTO_ERROR_24 = 0x31, // old style error (string)
     IPROTO_METADATA = 0x32, // SQL transaction metadata
+    IPROTO_BIND_METADATA = 0x33, // PREPARE: parameters metadata
+    IPROTO_BIND_COUNT    = 0x34, // PREPARE: number of parameters
     IPROTO_SQL_INFO = 0x42, // additional SQL-related parameters
     IPROTO_ERROR    = 0x52, // new style error (map with error stack)
 };
 
+/// SQL result column metadata keys (IPROTO_METADATA items)
+enum sql_metadata_field
+{
+    SQL_FIELD_NAME             = 0x00,
+    SQL_FIELD_TYPE             = 0x01,
+    SQL_FIELD_COLL             = 0x02,
+    SQL_FIELD_IS_NULLABLE      = 0x03,
+    SQL_FIELD_IS_AUTOINCREMENT = 0x04,
+    SQL_FIELD_SPAN             = 0x05,
+};
+
+/// IPROTO_SQL_INFO keys (DML results)
+enum sql_info_field
+{
+    SQL_INFO_ROW_COUNT         = 0x00,
+    SQL_INFO_AUTOINCREMENT_IDS = 0x01,
+};
+
 /// Request/response header field types (keys)
 enum header_field
 {
@@ -109,6 +164,33 @@ enum header_field
     LSN       = 0x03,
     TIMESTAMP = 0x04,
     SCHEMA_ID = 0x05, // IPROTO_SCHEMA_VERSION
+    STREAM_ID = 0x0a, // requests of a stream are executed sequentially (feature::STREAMS)
+};
+
+/// Transaction isolation levels (BEGIN request)
+enum class txn_isolation : uint8_t
+{
+    DEFAULT        = 0, ///< box.cfg.txn_isolation
+    READ_COMMITTED = 1,
+    READ_CONFIRMED = 2,
+    BEST_EFFORT    = 3,
+};
+
+/// Index iterator types
+enum class iterator_type : uint8_t
+{
+    EQ               = 0,
+    REQ              = 1,
+    ALL              = 2,
+    LT               = 3,
+    LE               = 4,
+    GE               = 5,
+    GT               = 6,
+    BITS_ALL_SET     = 7,
+    BITS_ANY_SET     = 8,
+    BITS_ALL_NOT_SET = 9,
+    OVERLAPS         = 10,
+    NEIGHBOR         = 11,
 };
 
 /// Update operations
@@ -131,6 +213,16 @@ enum subscription_field
     EVENT_DATA = 0x58,
 };
 
+/// Framed iproto message within an input batch (see connection::input_messages()).
+struct message_info
+{
+    size_t offset = 0;          ///< header position within the batch (the length prefix is skipped)
+    size_t size = 0;            ///< header + body size
+    uint64_t sync = 0;
+    uint32_t code = 0;          ///< response code (0 - ok, 0x8000 | db error code, EVENT and so on)
+    uint64_t schema_id = 0;
+};
+
 // https://www.tarantool.io/en/doc/latest/reference/internals/iproto/requests/#iproto-id
 struct proto_id
 {
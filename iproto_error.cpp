@@ -0,0 +1,87 @@
+#include "iproto_error.h"
+
+using namespace std;
+
+/// Tarantool connector scope
+namespace tnt
+{
+
+constexpr uint32_t MP_ERROR_STACK = 0x00; ///< the only key of IPROTO_ERROR/MP_ERROR map
+
+error_stack::error_stack(mp_plain error)
+{
+    if (!error.begin || error.begin == error.end)
+        return;
+    if (mp_typeof(*error.begin) == MP_EXT)
+    {
+        _stack = mp_array(error.begin, error.end); // acquires MP_ERROR_STACK
+        return;
+    }
+
+    auto body = mp_reader(error).read<mp_map_reader>();
+    while (body.has_next())
+    {
+        if (body.read<uint32_t>() != MP_ERROR_STACK)
+        {
+            body.skip();
+            continue;
+        }
+        auto stack = body.read<mp_array_reader>();
+        _stack = mp_array(stack.begin(), stack.end(), stack.cardinality());
+        return;
+    }
+    throw mp_reader_error("MP_ERROR_STACK not found within error", error);
+}
+
+string error_stack::to_string() const
+{
+    string res;
+    for (const auto &e: *this)
+    {
+        if (!res.empty())
+            res += " <- ";
+        res += e.message;
+    }
+    return res;
+}
+
+error_stack::iterator::iterator(const char *pos, const char *end, size_t left)
+    : _pos(pos), _end(end), _left(left + 1)
+{
+    ++*this;
+}
+
+error_stack::iterator& error_stack::iterator::operator++()
+{
+    if (!_left || !--_left)
+        return *this;
+
+    _current = {};
+    auto r = mp_reader(mp_plain{_pos, _end});
+    auto item = r.read<mp_map_reader>();
+    while (item.has_next())
+    {
+        switch (item.read<uint32_t>())
+        {
+        case MP_ERROR_TYPE:    item >> _current.type; break;
+        case MP_ERROR_FILE:    item >> _current.file; break;
+        case MP_ERROR_LINE:    item >> _current.line; break;
+        case MP_ERROR_MESSAGE: item >> _current.message; break;
+        case MP_ERROR_ERRNO:   item >> _current.saved_errno; break;
+        case MP_ERROR_ERRCODE: item >> _current.code; break;
+        case MP_ERROR_FIELDS:
+        {
+            auto begin = item.pos();
+            item.skip();
+            _current.fields = {begin, item.pos()};
+            break;
+        }
+        default:
+            item.skip();
+        }
+    }
+    _pos = r.pos();
+    return *this;
+}
+
+} // namespace tnt
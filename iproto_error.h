@@ -0,0 +1,119 @@
+#ifndef IPROTO_ERROR_H
+#define IPROTO_ERROR_H
+
+/** @file */
+
+#include <string>
+#include <string_view>
+#include "iproto.h"
+#include "mp_reader.h"
+
+/// Tarantool connector scope
+namespace tnt
+{
+
+/// Error stack item. Strings refer to the response buffer (no allocation).
+struct error_info
+{
+    std::string_view type;      ///< e.g. "ClientError"
+    std::string_view message;
+    std::string_view file;
+    uint32_t line = 0;
+    uint32_t saved_errno = 0;
+    uint32_t code = 0;
+    mp_plain fields;            ///< MP_ERROR_FIELDS map (empty if absent)
+
+    bool is(db_error err) const noexcept
+    {
+        return code == static_cast<uint32_t>(err);
+    }
+};
+
+/** Typed view over an error stack: IPROTO_ERROR response field or MP_ERROR
+ *  ext value. Items are decoded on iteration, nothing is allocated until
+ *  to_string() is requested. The first item is the most recent error.
+ *
+ *  \code
+ *  tnt::error_stack errors(body[tnt::response_field::IPROTO_ERROR]);
+ *  if (errors.code() == tnt::db_error::TUPLE_FOUND)
+ *      ...
+ *  for (const tnt::error_info &e: errors)
+ *      log(e.type, e.message);
+ *  \endcode
+ */
+class error_stack
+{
+public:
+    class iterator
+    {
+    public:
+        using value_type = error_info;
+        using difference_type = std::ptrdiff_t;
+
+        iterator() = default;
+        const error_info& operator*() const noexcept { return _current; }
+        const error_info* operator->() const noexcept { return &_current; }
+        iterator& operator++();
+        iterator operator++(int)
+        {
+            auto tmp = *this;
+            ++*this;
+            return tmp;
+        }
+        bool operator==(const iterator &other) const noexcept
+        {
+            return _left == other._left;
+        }
+
+    private:
+        friend class error_stack;
+        iterator(const char *pos, const char *end, size_t left);
+
+        const char *_pos = nullptr;
+        const char *_end = nullptr;
+        size_t _left = 0;
+        error_info _current;
+    };
+
+    error_stack() = default;
+    /// IPROTO_ERROR value (map with the stack) or MP_ERROR ext value.
+    explicit error_stack(mp_plain error);
+    template <typename MP>
+    explicit error_stack(const mp_reader<MP> &error) : error_stack(mp_plain{error.pos(), error.end()}) {}
+
+    size_t size() const noexcept
+    {
+        return _stack.cardinality;
+    }
+    bool empty() const noexcept
+    {
+        return !_stack.cardinality;
+    }
+    iterator begin() const
+    {
+        return {_stack.begin, _stack.end, _stack.cardinality};
+    }
+    iterator end() const noexcept
+    {
+        return {};
+    }
+    /// The most recent error (empty if the stack is empty).
+    error_info front() const
+    {
+        return empty() ? error_info{} : *begin();
+    }
+    /// Code of the most recent error.
+    db_error code() const
+    {
+        return static_cast<db_error>(front().code);
+    }
+    /// Messages of the whole stack ("message <- reason <- ...").
+    std::string to_string() const;
+
+private:
+    mp_array _stack;
+};
+
+} // namespace tnt
+
+#endif // IPROTO_ERROR_H
@@ -39,9 +39,9 @@ void iproto_writer::start_message()
 {
     finalize_all();
 
-    // ensure we have 1kb free (make prereserve manually if you need some more)
-    if (_buf.capacity() - _buf.size() < 1024)
-        _buf.reserve(static_cast<size_t>(_buf.capacity() + 1024));
+    // ensure we have 1kb free for the message header and manual writes
+    // (use ensure() if you need some more)
+    ensure(1024);
 
     size_t head_offset = _buf.size();
     _opened_containers.push({head_offset, std::numeric_limits<uint32_t>::max()});
@@ -82,9 +82,11 @@ void iproto_writer::finalize_all()
 void iproto_writer::encode_request_header(request_type req_type)
 {
     start_message();
-    _buf.end = mp_encode_map(_buf.end, 2);
+    _buf.end = mp_encode_map(_buf.end, _stream_id ? 3 : 2);
     _buf.end = mp_encode_uint(mp_encode_uint(_buf.end, tnt::header_field::CODE), static_cast<uint8_t>(req_type));
     _buf.end = mp_encode_uint(mp_encode_uint(_buf.end, tnt::header_field::SYNC), get_request_id());
+    if (_stream_id)
+        _buf.end = mp_encode_uint(mp_encode_uint(_buf.end, tnt::header_field::STREAM_ID), _stream_id);
 }
 
 void iproto_writer::encode_response_header(uint32_t error_code, uint64_t schema_version)
@@ -100,6 +102,10 @@ void iproto_writer::encode_response_header(uint32_t error_code, uint64_t schema_
 void iproto_writer::encode_auth_request(const char* greeting, std::string_view user, std::string_view password, std::string_view auth_proto)
 {
     encode_request_header(tnt::request_type::AUTH);
+    ensure(mp_sizeof_map(2) +
+           mp_sizeof_uint(tnt::body_field::USER_NAME) + mp_sizeof_str(static_cast<uint32_t>(user.size())) +
+           mp_sizeof_uint(tnt::body_field::TUPLE) + mp_sizeof_array(2) +
+           mp_sizeof_str(static_cast<uint32_t>(auth_proto.size())) + mp_sizeof_str(tnt::SCRAMBLE_SIZE));
 
     _buf.end = mp_encode_map(_buf.end, 2);
     _buf.end = mp_encode_strl(mp_encode_uint(_buf.end, tnt::body_field::USER_NAME),
@@ -126,6 +132,11 @@ void iproto_writer::encode_auth_request(const char* greeting, std::string_view u
 void iproto_writer::encode_id_request(proto_id proto)
 {
     encode_request_header(tnt::request_type::PROTO_ID);
+    auto features = proto.list_features();
+    ensure(mp_sizeof_map(3) +
+           mp_sizeof_uint(tnt::body_field::VERSION) + mp_sizeof_uint(proto.version) +
+           mp_sizeof_uint(tnt::body_field::FEATURES) + mp_sizeof_array(features.size()) + features.size() * 9 +
+           mp_sizeof_uint(tnt::body_field::AUTH_TYPE) + mp_sizeof_str(static_cast<uint32_t>(proto.auth.size())));
     _buf.end = mp_encode_map(_buf.end, 1 + (proto.version ? 1 : 0) + (proto.auth.empty() ? 0 : 1));
 
     if (proto.version)
@@ -134,7 +145,6 @@ void iproto_writer::encode_id_request(proto_id proto)
         _buf.end = mp_encode_uint(_buf.end, proto.version);
     }
 
-    auto features = proto.list_features();
     _buf.end = mp_encode_uint(_buf.end, tnt::body_field::FEATURES);
     _buf.end = mp_encode_array(_buf.end, features.size());
     // actually we could memcpy features as is
@@ -156,9 +166,147 @@ void iproto_writer::encode_ping_request()
     finalize();
 }
 
+void iproto_writer::encode_watch_request(std::string_view key)
+{
+    encode_key_request(tnt::request_type::WATCH, key);
+}
+
+void iproto_writer::encode_unwatch_request(std::string_view key)
+{
+    encode_key_request(tnt::request_type::UNWATCH, key);
+}
+
+void iproto_writer::encode_watch_once_request(std::string_view key)
+{
+    encode_key_request(tnt::request_type::WATCH_ONCE, key);
+}
+
+void iproto_writer::encode_key_request(request_type type, std::string_view key)
+{
+    encode_request_header(type);
+    ensure(mp_sizeof_map(1) +
+           mp_sizeof_uint(tnt::subscription_field::EVENT_KEY) + mp_sizeof_str(static_cast<uint32_t>(key.size())));
+
+    _buf.end = mp_encode_map(_buf.end, 1);
+    _buf.end = mp_encode_uint(_buf.end, tnt::subscription_field::EVENT_KEY);
+    _buf.end = mp_encode_str(_buf.end, key.data(), static_cast<uint32_t>(key.size()));
+    finalize();
+}
+
+void iproto_writer::encode_begin_request(double timeout, txn_isolation isolation)
+{
+    encode_request_header(tnt::request_type::BEGIN);
+    _buf.end = mp_encode_map(_buf.end, (timeout > 0 ? 1 : 0) + (isolation != txn_isolation::DEFAULT ? 1 : 0));
+    if (timeout > 0)
+        _buf.end = mp_encode_double(mp_encode_uint(_buf.end, tnt::body_field::TIMEOUT), timeout);
+    if (isolation != txn_isolation::DEFAULT)
+        _buf.end = mp_encode_uint(mp_encode_uint(_buf.end, tnt::body_field::TXN_ISOLATION), static_cast<uint8_t>(isolation));
+    finalize();
+}
+
+void iproto_writer::encode_commit_request()
+{
+    encode_request_header(tnt::request_type::COMMIT);
+    _buf.end = mp_encode_map(_buf.end, 0);
+    finalize();
+}
+
+void iproto_writer::encode_rollback_request()
+{
+    encode_request_header(tnt::request_type::ROLLBACK);
+    _buf.end = mp_encode_map(_buf.end, 0);
+    finalize();
+}
+
+void iproto_writer::begin_select(uint32_t space_id, uint32_t index_id, uint32_t limit, uint32_t offset, iterator_type iterator)
+{
+    encode_request_header(tnt::request_type::SELECT);
+    ensure(mp_sizeof_map(6) + 6 + mp_sizeof_uint(space_id) + mp_sizeof_uint(index_id) +
+           mp_sizeof_uint(limit) + mp_sizeof_uint(offset) + mp_sizeof_uint(static_cast<uint8_t>(iterator)));
+
+    _buf.end = mp_encode_map(_buf.end, 6);
+    _buf.end = mp_encode_uint(mp_encode_uint(_buf.end, tnt::body_field::SPACE), space_id);
+    _buf.end = mp_encode_uint(mp_encode_uint(_buf.end, tnt::body_field::INDEX), index_id);
+    _buf.end = mp_encode_uint(mp_encode_uint(_buf.end, tnt::body_field::LIMIT), limit);
+    _buf.end = mp_encode_uint(mp_encode_uint(_buf.end, tnt::body_field::OFFSET), offset);
+    _buf.end = mp_encode_uint(mp_encode_uint(_buf.end, tnt::body_field::ITERATOR), static_cast<uint8_t>(iterator));
+    _buf.end = mp_encode_uint(_buf.end, tnt::body_field::KEY);
+    // a caller must append the key (zero-length array to select all)
+}
+
+void iproto_writer::begin_space_request(request_type type, uint32_t space_id)
+{
+    encode_request_header(type);
+    ensure(mp_sizeof_map(2) + 2 + mp_sizeof_uint(space_id));
+
+    _buf.end = mp_encode_map(_buf.end, 2);
+    _buf.end = mp_encode_uint(mp_encode_uint(_buf.end, tnt::body_field::SPACE), space_id);
+    _buf.end = mp_encode_uint(_buf.end, tnt::body_field::TUPLE);
+}
+
+const space_info& iproto_writer::resolve_space(const schema &sc, std::string_view space)
+{
+    auto s = sc.space(space);
+    if (!s)
+        throw std::runtime_error("unknown space " + std::string(space));
+    return *s;
+}
+
+void iproto_writer::encode_prepare_request(std::string_view sql)
+{
+    encode_request_header(tnt::request_type::PREPARE);
+    ensure(mp_sizeof_map(1) +
+           mp_sizeof_uint(tnt::body_field::SQL_TEXT) + mp_sizeof_str(static_cast<uint32_t>(sql.size())));
+
+    _buf.end = mp_encode_map(_buf.end, 1);
+    _buf.end = mp_encode_uint(_buf.end, tnt::body_field::SQL_TEXT);
+    _buf.end = mp_encode_str(_buf.end, sql.data(), static_cast<uint32_t>(sql.size()));
+    finalize();
+}
+
+void iproto_writer::encode_unprepare_request(uint64_t stmt_id)
+{
+    encode_request_header(tnt::request_type::PREPARE);
+    ensure(mp_sizeof_map(1) + mp_sizeof_uint(tnt::body_field::STMT_ID) + mp_sizeof_uint(stmt_id));
+
+    _buf.end = mp_encode_map(_buf.end, 1);
+    _buf.end = mp_encode_uint(mp_encode_uint(_buf.end, tnt::body_field::STMT_ID), stmt_id);
+    finalize();
+}
+
+void iproto_writer::begin_execute(std::string_view sql)
+{
+    encode_request_header(tnt::request_type::EXECUTE);
+    ensure(mp_sizeof_map(2) +
+           mp_sizeof_uint(tnt::body_field::SQL_TEXT) + mp_sizeof_str(static_cast<uint32_t>(sql.size())) +
+           mp_sizeof_uint(tnt::body_field::SQL_BIND));
+
+    _buf.end = mp_encode_map(_buf.end, 2);
+    _buf.end = mp_encode_uint(_buf.end, tnt::body_field::SQL_TEXT);
+    _buf.end = mp_encode_str(_buf.end, sql.data(), static_cast<uint32_t>(sql.size()));
+    _buf.end = mp_encode_uint(_buf.end, tnt::body_field::SQL_BIND);
+    // a caller must append an array of parameters (zero-length one if none)
+}
+
+void iproto_writer::begin_execute(uint64_t stmt_id)
+{
+    encode_request_header(tnt::request_type::EXECUTE);
+    ensure(mp_sizeof_map(2) +
+           mp_sizeof_uint(tnt::body_field::STMT_ID) + mp_sizeof_uint(stmt_id) +
+           mp_sizeof_uint(tnt::body_field::SQL_BIND));
+
+    _buf.end = mp_encode_map(_buf.end, 2);
+    _buf.end = mp_encode_uint(mp_encode_uint(_buf.end, tnt::body_field::STMT_ID), stmt_id);
+    _buf.end = mp_encode_uint(_buf.end, tnt::body_field::SQL_BIND);
+    // a caller must append an array of parameters (zero-length one if none)
+}
+
 void iproto_writer::begin_call(std::string_view fn_name)
 {
     encode_request_header(tnt::request_type::CALL);
+    ensure(mp_sizeof_map(2) +
+           mp_sizeof_uint(tnt::body_field::FUNCTION_NAME) + mp_sizeof_str(static_cast<uint32_t>(fn_name.size())) +
+           mp_sizeof_uint(tnt::body_field::TUPLE));
 
     _buf.end = mp_encode_map(_buf.end, 2);
     _buf.end = mp_encode_uint(_buf.end, tnt::body_field::FUNCTION_NAME);
@@ -170,6 +318,9 @@ void iproto_writer::begin_call(std::string_view fn_name)
 void iproto_writer::begin_eval(std::string_view script)
 {
     encode_request_header(tnt::request_type::EVAL);
+    ensure(mp_sizeof_map(2) +
+           mp_sizeof_uint(tnt::body_field::EXPRESSION) + mp_sizeof_str(static_cast<uint32_t>(script.size())) +
+           mp_sizeof_uint(tnt::body_field::TUPLE));
 
     _buf.end = mp_encode_map(_buf.end, 2);
     _buf.end = mp_encode_uint(_buf.end, tnt::body_field::EXPRESSION);
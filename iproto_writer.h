@@ -1,8 +1,10 @@
 #ifndef IPROTO_WRITER_H
 #define IPROTO_WRITER_H
 
+#include <limits>
 #include "mp_writer.h"
 #include "iproto.h"
+#include "schema.h"
 
 /// Tarantool connector scope
 namespace tnt
@@ -10,7 +12,7 @@ namespace tnt
 
 /** Helper to compose iproto messages.
 *
-* A caller must ensure there is enough free space in the underlying buffer.
+* The underlying buffer grows automatically (see mp_writer::ensure()).
 */
 class iproto_writer : public mp_writer
 {
@@ -40,6 +42,33 @@ public:
     /// Put ping request into the underlying buffer.
     void encode_ping_request();
 
+    /** Subsequent requests go to the stream (header_field::STREAM_ID), 0 - no stream.
+     *  Requests of a stream are executed sequentially, interactive transactions need one
+     *  (see tnt::transaction). */
+    void set_stream_id(uint64_t stream_id) noexcept
+    {
+        _stream_id = stream_id;
+    }
+
+    uint64_t stream_id() const noexcept
+    {
+        return _stream_id;
+    }
+
+    /// Put WATCH request into the underlying buffer (subscribe to the key or acknowledge its notification).
+    void encode_watch_request(std::string_view key);
+    /// Put UNWATCH request into the underlying buffer.
+    void encode_unwatch_request(std::string_view key);
+    /// Put WATCH_ONCE request into the underlying buffer (fetch the key value without subscription).
+    void encode_watch_once_request(std::string_view key);
+
+    /// Put BEGIN request into the underlying buffer (timeout in seconds, 0 - box.cfg.txn_timeout).
+    void encode_begin_request(double timeout = 0, txn_isolation isolation = txn_isolation::DEFAULT);
+    /// Put COMMIT request into the underlying buffer.
+    void encode_commit_request();
+    /// Put ROLLBACK request into the underlying buffer.
+    void encode_rollback_request();
+
     /// Initiate call request. A caller must pass an array of arguments afterwards
     /// and call finalize() to finalize request.
     void begin_call(std::string_view fn_name);
@@ -66,9 +95,156 @@ public:
         finalize_all();
     }
 
+    /// Initiate select request. A caller must pass the key (array) afterwards
+    /// and call finalize() to finalize request.
+    void begin_select(uint32_t space_id, uint32_t index_id = 0,
+                      uint32_t limit = std::numeric_limits<uint32_t>::max(), uint32_t offset = 0,
+                      iterator_type iterator = iterator_type::EQ);
+
+    /// Select request all-in-one wrapper, e.g. `w.encode_select_request(512, 0, std::make_tuple(1))`.
+    template <typename Key = std::tuple<>>
+    void encode_select_request(uint32_t space_id, uint32_t index_id, const Key &key = {},
+                               uint32_t limit = std::numeric_limits<uint32_t>::max(), uint32_t offset = 0,
+                               iterator_type iterator = iterator_type::EQ)
+    {
+        begin_select(space_id, index_id, limit, offset, iterator);
+        *this << key;
+        finalize_all();
+    }
+
+    /// Select request by space and index names (see connection::schema()).
+    template <typename Key = std::tuple<>>
+    void encode_select_request(const schema &sc, std::string_view space, std::string_view index, const Key &key = {},
+                               uint32_t limit = std::numeric_limits<uint32_t>::max(), uint32_t offset = 0,
+                               iterator_type iterator = iterator_type::EQ)
+    {
+        const space_info &s = resolve_space(sc, space);
+        auto index_id = s.index_id(index);
+        if (!index_id)
+            throw std::runtime_error("unknown index " + std::string(space) + "." + std::string(index));
+        encode_select_request(s.id, *index_id, key, limit, offset, iterator);
+    }
+
+    /// Insert request, the tuple must be serialized as an array.
+    template <typename Tuple>
+    void encode_insert_request(uint32_t space_id, const Tuple &tuple)
+    {
+        begin_space_request(request_type::INSERT, space_id);
+        *this << tuple;
+        finalize_all();
+    }
+
+    template <typename Tuple>
+    void encode_insert_request(const schema &sc, std::string_view space, const Tuple &tuple)
+    {
+        encode_insert_request(resolve_space(sc, space).id, tuple);
+    }
+
+    /// Replace request, the tuple must be serialized as an array.
+    template <typename Tuple>
+    void encode_replace_request(uint32_t space_id, const Tuple &tuple)
+    {
+        begin_space_request(request_type::REPLACE, space_id);
+        *this << tuple;
+        finalize_all();
+    }
+
+    template <typename Tuple>
+    void encode_replace_request(const schema &sc, std::string_view space, const Tuple &tuple)
+    {
+        encode_replace_request(resolve_space(sc, space).id, tuple);
+    }
+
+    /// Put SQL PREPARE request into the underlying buffer.
+    void encode_prepare_request(std::string_view sql);
+    /// Put a request to deallocate the prepared statement (PREPARE by statement id).
+    void encode_unprepare_request(uint64_t stmt_id);
+
+    /// Initiate SQL EXECUTE request by SQL text. A caller must pass an array
+    /// of parameters afterwards and call finalize() to finalize request.
+    void begin_execute(std::string_view sql);
+    /// Initiate SQL EXECUTE request by prepared statement id (see begin_execute()).
+    void begin_execute(uint64_t stmt_id);
+
+    /// Execute request all-in-one wrapper, e.g. `w.execute("SELECT * FROM t WHERE id = ?", 1)`.
+    template <typename ...Ts>
+    void execute(std::string_view sql, Ts const&... args)
+    {
+        begin_execute(sql);
+        begin_array(sizeof...(args));
+        ((*this << args), ...);
+        finalize_all();
+    }
+
+    /// Execute request all-in-one wrapper (by prepared statement id).
+    template <typename ...Ts>
+    void execute(uint64_t stmt_id, Ts const&... args)
+    {
+        begin_execute(stmt_id);
+        begin_array(sizeof...(args));
+        ((*this << args), ...);
+        finalize_all();
+    }
+
+    /** Call request with the function name and constant arguments encoded at compile time,
+     *  e.g. `w.static_call<"box.space.test:replace", 1, "const"_fs>(runtime_arg)`
+     *  (see mp_static for supported constants). Only the sync and runtime arguments
+     *  are encoded per call. */
+    template <mp_fixed_string Fn, auto... ConstArgs, typename... Ts>
+    void static_call(Ts const&... args)
+    {
+        encode_static_request<request_type::CALL, body_field::FUNCTION_NAME, Fn, ConstArgs...>(args...);
+    }
+
+    /// Eval request with the script and constant arguments encoded at compile time (see static_call()).
+    template <mp_fixed_string Script, auto... ConstArgs, typename... Ts>
+    void static_eval(Ts const&... args)
+    {
+        encode_static_request<request_type::EVAL, body_field::EXPRESSION, Script, ConstArgs...>(args...);
+    }
+
     using mp_writer::operator<<;
 private:
+    /// Insert/replace header and body up to the tuple.
+    void begin_space_request(request_type type, uint32_t space_id);
+    /// Watchers' requests (the body is the event key only).
+    void encode_key_request(request_type type, std::string_view key);
+    static const space_info& resolve_space(const schema &sc, std::string_view space);
+
+    template <request_type Type, body_field NameKey, mp_fixed_string Name, auto... ConstArgs, typename... Ts>
+    void encode_static_request(Ts const&... args)
+    {
+        // header up to the sync value
+        static constexpr auto head = mp_static_encode_all<
+            mp_map_header{2}, header_field::CODE, Type, header_field::SYNC>();
+        // the same within a stream (the stream id goes after the sync)
+        static constexpr auto stream_head = mp_static_encode_all<
+            mp_map_header{3}, header_field::CODE, Type, header_field::SYNC>();
+        // body up to runtime arguments
+        static constexpr auto body = mp_static_encode_all<
+            mp_map_header{2}, NameKey, Name,
+            body_field::TUPLE, mp_array_header{static_cast<uint32_t>(mp_static_cardinality<ConstArgs...>() + sizeof...(Ts))}, ConstArgs...>();
+
+        start_message();
+        ensure(head.size() + 9 + 10 + body.size());
+        if (_stream_id)
+        {
+            _buf.end = std::copy(stream_head.begin(), stream_head.end(), _buf.end);
+            _buf.end = mp_encode_uint(_buf.end, get_request_id());
+            _buf.end = mp_encode_uint(mp_encode_uint(_buf.end, header_field::STREAM_ID), _stream_id);
+        }
+        else
+        {
+            _buf.end = std::copy(head.begin(), head.end(), _buf.end);
+            _buf.end = mp_encode_uint(_buf.end, get_request_id());
+        }
+        _buf.end = std::copy(body.begin(), body.end(), _buf.end);
+        ((*this << args), ...);
+        finalize();
+    }
+
     std::function<uint64_t()> get_request_id;
+    uint64_t _stream_id = 0;
 };
 
 } // namespace tnt
@@ -0,0 +1,630 @@
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <cstring>
+#include "msgpuck/msgpuck.h"
+#include "mp_json.h"
+
+using namespace std;
+
+namespace
+{
+
+constexpr size_t string_chunk = 4096; ///< input bytes escaped per output reservation
+constexpr uint64_t ones = 0x0101010101010101ull;
+constexpr uint64_t highs = 0x8080808080808080ull;
+
+/// Nonzero if any byte of v is zero.
+inline uint64_t has_zero(uint64_t v) noexcept
+{
+    return (v - ones) & ~v & highs;
+}
+
+/// Nonzero if any byte of v needs to be escaped (control characters, '"' and '\').
+inline uint64_t needs_escape(uint64_t v) noexcept
+{
+    return has_zero(v ^ (ones * '"')) | has_zero(v ^ (ones * '\\')) | ((v - ones * 0x20) & ~v & highs);
+}
+
+inline char* escape(char *out, char c) noexcept
+{
+    constexpr char hexmap[] = {"0123456789abcdef"};
+    switch (c)
+    {
+    case '"':  *out++ = '\\'; *out++ = '"'; break;
+    case '\\': *out++ = '\\'; *out++ = '\\'; break;
+    case '\b': *out++ = '\\'; *out++ = 'b'; break;
+    case '\f': *out++ = '\\'; *out++ = 'f'; break;
+    case '\n': *out++ = '\\'; *out++ = 'n'; break;
+    case '\r': *out++ = '\\'; *out++ = 'r'; break;
+    case '\t': *out++ = '\\'; *out++ = 't'; break;
+    default:
+        if (static_cast<uint8_t>(c) < 0x20)
+        {
+            memcpy(out, "\\u00", 4);
+            out[4] = hexmap[(c & 0xF0) >> 4];
+            out[5] = hexmap[c & 0x0F];
+            out += 6;
+        }
+        else
+        {
+            *out++ = c;
+        }
+    }
+    return out;
+}
+
+} // namespace
+
+mp_json_writer::mp_json_writer(wtf_buffer &buf) : _buf(buf) {}
+
+mp_json_writer::mp_json_writer(wtf_buffer &buf, size_t chunk_size, chunk_handler &&handler)
+    : _buf(buf), _chunk_size(chunk_size), _chunk_handler(std::move(handler)) {}
+
+mp_json_writer& mp_json_writer::operator<<(const mp_plain &item)
+{
+    const char *pos = item.begin;
+    if (pos >= item.end || mp_check(&pos, item.end))
+        throw mp_reader_error("invalid messagepack", item, item.begin);
+    pos = item.begin;
+    _containers.clear();
+
+    for (;;)
+    {
+        bool is_key = !_containers.empty() && _containers.back().is_map && !(_containers.back().remaining & 1);
+        auto type = mp_typeof(*pos);
+        if (is_key && (type == MP_ARRAY || type == MP_MAP || type == MP_EXT))
+            throw mp_reader_error("unable to convert " + mpuck_type_name(type) + " map key to json", item, pos);
+
+        if (type == MP_ARRAY || type == MP_MAP)
+        {
+            bool is_map = type == MP_MAP;
+            uint32_t cardinality = is_map ? mp_decode_map(&pos) : mp_decode_array(&pos);
+            ensure(2);
+            put(is_map ? '{' : '[');
+            if (cardinality)
+            {
+                _containers.push_back({is_map ? cardinality * 2 : cardinality, is_map});
+                continue;
+            }
+            put(is_map ? '}' : ']');
+        }
+        else
+        {
+            write_scalar(pos, is_key);
+        }
+
+        // the item is complete, close finished containers and put the separator
+        for (;;)
+        {
+            if (_containers.empty())
+            {
+                maybe_flush();
+                return *this;
+            }
+            auto &c = _containers.back();
+            ensure(1);
+            if (--c.remaining)
+            {
+                put(c.is_map && (c.remaining & 1) ? ':' : ',');
+                break;
+            }
+            put(c.is_map ? '}' : ']');
+            _containers.pop_back();
+        }
+        maybe_flush();
+    }
+}
+
+void mp_json_writer::flush()
+{
+    if (_chunk_handler && _buf.size())
+        _chunk_handler(_buf);
+}
+
+void mp_json_writer::ensure(size_t size)
+{
+    if (_buf.available() < size) [[unlikely]]
+        _buf.reserve(std::max(_buf.size() + size, _buf.capacity() + _buf.capacity() / 2));
+}
+
+void mp_json_writer::maybe_flush()
+{
+    if (_chunk_handler && _buf.size() >= _chunk_size)
+        _chunk_handler(_buf);
+}
+
+void mp_json_writer::write_scalar(const char *&pos, bool is_key)
+{
+    auto type = mp_typeof(*pos);
+    if (type == MP_STR)
+    {
+        uint32_t len;
+        const char *data = mp_decode_str(&pos, &len);
+        write_string(data, len);
+        return;
+    }
+    if (type == MP_BIN)
+    {
+        uint32_t len;
+        const char *data = mp_decode_bin(&pos, &len);
+        write_base64(data, len);
+        return;
+    }
+    if (type == MP_EXT)
+    {
+        write_ext(pos);
+        return;
+    }
+
+    ensure(32);
+    if (is_key) // json keys are strings only
+        put('"');
+    char *end = _buf.end + 30;
+    switch (type)
+    {
+    case MP_NIL:
+        mp_decode_nil(&pos);
+        _buf.end = std::copy_n("null", 4, _buf.end);
+        break;
+    case MP_BOOL:
+        if (mp_decode_bool(&pos))
+            _buf.end = std::copy_n("true", 4, _buf.end);
+        else
+            _buf.end = std::copy_n("false", 5, _buf.end);
+        break;
+    case MP_UINT:
+        _buf.end = to_chars(_buf.end, end, mp_decode_uint(&pos)).ptr;
+        break;
+    case MP_INT:
+        _buf.end = to_chars(_buf.end, end, mp_decode_int(&pos)).ptr;
+        break;
+    case MP_FLOAT:
+    case MP_DOUBLE:
+    {
+        // shortest representation which reads back to the same value
+        if (type == MP_FLOAT)
+        {
+            float val = mp_decode_float(&pos);
+            _buf.end = std::isfinite(val) ? to_chars(_buf.end, end, val).ptr : std::copy_n("null", 4, _buf.end);
+        }
+        else
+        {
+            double val = mp_decode_double(&pos);
+            _buf.end = std::isfinite(val) ? to_chars(_buf.end, end, val).ptr : std::copy_n("null", 4, _buf.end);
+        }
+        break;
+    }
+    default:
+        break;
+    }
+    if (is_key)
+        put('"');
+}
+
+void mp_json_writer::write_string(const char *data, size_t size)
+{
+    ensure(1);
+    put('"');
+    while (size)
+    {
+        size_t chunk = std::min(size, string_chunk);
+        ensure(chunk * 6 + 1); // "\u00XX" at worst
+        const char *p = data;
+        const char *end = data + chunk;
+        char *out = _buf.end;
+        while (end - p >= 8)
+        {
+            uint64_t v;
+            memcpy(&v, p, 8);
+            if (!needs_escape(v))
+            {
+                memcpy(out, p, 8);
+                out += 8;
+                p += 8;
+                continue;
+            }
+            for (const char *block_end = p + 8; p < block_end; ++p)
+                out = escape(out, *p);
+        }
+        while (p < end)
+            out = escape(out, *p++);
+        _buf.end = out;
+        data += chunk;
+        size -= chunk;
+        if (size)
+            maybe_flush();
+    }
+    ensure(1);
+    put('"');
+}
+
+void mp_json_writer::write_base64(const char *data, size_t size)
+{
+    constexpr char alphabet[] = {"ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/"};
+    ensure(1);
+    put('"');
+    auto src = reinterpret_cast<const uint8_t*>(data);
+    while (size)
+    {
+        size_t chunk = std::min(size, string_chunk / 3 * 3);
+        ensure(chunk / 3 * 4 + 4);
+        char *out = _buf.end;
+        size_t i = 0;
+        for (; i + 3 <= chunk; i += 3)
+        {
+            uint32_t triple = (src[i] << 16) | (src[i + 1] << 8) | src[i + 2];
+            *out++ = alphabet[(triple >> 18) & 0x3F];
+            *out++ = alphabet[(triple >> 12) & 0x3F];
+            *out++ = alphabet[(triple >> 6) & 0x3F];
+            *out++ = alphabet[triple & 0x3F];
+        }
+        if (i < chunk) // the very last 1 or 2 bytes
+        {
+            uint32_t triple = src[i] << 16;
+            if (i + 1 < chunk)
+                triple |= src[i + 1] << 8;
+            *out++ = alphabet[(triple >> 18) & 0x3F];
+            *out++ = alphabet[(triple >> 12) & 0x3F];
+            *out++ = i + 1 < chunk ? alphabet[(triple >> 6) & 0x3F] : '=';
+            *out++ = '=';
+        }
+        _buf.end = out;
+        src += chunk;
+        size -= chunk;
+        if (size)
+            maybe_flush();
+    }
+    ensure(1);
+    put('"');
+}
+
+void mp_json_writer::write_ext(const char *&pos)
+{
+    ensure(64);
+    int cnt = mp_snprint(_buf.end, static_cast<int>(_buf.available()), pos, 0);
+    if (cnt >= 0 && static_cast<size_t>(cnt) >= _buf.available())
+    {
+        ensure(static_cast<size_t>(cnt) + 1);
+        cnt = mp_snprint(_buf.end, static_cast<int>(_buf.available()), pos, 0);
+    }
+    if (cnt < 0)
+        throw mp_reader_error("mp_snprint error", mp_plain{pos, nullptr}, pos);
+    _buf.end += cnt;
+    mp_next(&pos);
+}
+
+namespace
+{
+
+/// Single pass JSON to msgpack transcoder.
+class json_transcoder
+{
+public:
+    json_transcoder(mp_writer &w, string_view json)
+        : _w(w), _begin(json.data()), _p(json.data()), _end(json.data() + json.size()) {}
+
+    void run()
+    {
+        vector<char> containers; // '[' or '{'
+        bool expect_key = false;
+        for (;;)
+        {
+            skip_whitespace();
+            if (expect_key)
+            {
+                if (!consume('"'))
+                    fail("object key expected");
+                write_string();
+                skip_whitespace();
+                if (!consume(':'))
+                    fail("':' expected");
+                skip_whitespace();
+                expect_key = false;
+            }
+
+            if (_p == _end)
+                fail("value expected");
+            switch (*_p)
+            {
+            case '{':
+            case '[':
+            {
+                bool is_map = *_p++ == '{';
+                if (is_map)
+                    _w.begin_map(0);
+                else
+                    _w.begin_array(0);
+                skip_whitespace();
+                if (consume(is_map ? '}' : ']'))
+                {
+                    _w.finalize();
+                    break;
+                }
+                containers.push_back(is_map ? '{' : '[');
+                expect_key = is_map;
+                continue;
+            }
+            case '"':
+                ++_p;
+                write_string();
+                break;
+            case 't':
+                write_literal("true", true);
+                break;
+            case 'f':
+                write_literal("false", false);
+                break;
+            case 'n':
+                write_literal("null", nullptr);
+                break;
+            default:
+                write_number();
+            }
+
+            // the value is complete, close finished containers
+            for (;;)
+            {
+                skip_whitespace();
+                if (containers.empty())
+                {
+                    if (_p != _end)
+                        fail("unexpected trailing characters");
+                    return;
+                }
+                if (consume(','))
+                {
+                    expect_key = containers.back() == '{';
+                    break;
+                }
+                if (!consume(containers.back() == '{' ? '}' : ']'))
+                    fail(containers.back() == '{' ? "',' or '}' expected" : "',' or ']' expected");
+                _w.finalize();
+                containers.pop_back();
+            }
+        }
+    }
+
+private:
+    mp_writer &_w;
+    const char *_begin;
+    const char *_p;
+    const char *_end;
+
+    [[noreturn]] void fail(const char *what) const
+    {
+        throw runtime_error(string("json parse error at offset ") + std::to_string(_p - _begin) + ": " + what);
+    }
+
+    void skip_whitespace() noexcept
+    {
+        while (_p < _end && (*_p == ' ' || *_p == '\n' || *_p == '\r' || *_p == '\t'))
+            ++_p;
+    }
+
+    bool consume(char c) noexcept
+    {
+        if (_p < _end && *_p == c)
+        {
+            ++_p;
+            return true;
+        }
+        return false;
+    }
+
+    template <typename T>
+    void write_literal(string_view literal, T value)
+    {
+        if (static_cast<size_t>(_end - _p) < literal.size() || string_view(_p, literal.size()) != literal)
+            fail("unexpected literal");
+        _p += literal.size();
+        _w << value;
+    }
+
+    void write_number()
+    {
+        const char *begin = _p;
+        bool is_integer = true;
+        for (; _p < _end; ++_p)
+        {
+            char c = *_p;
+            if (c == '.' || c == 'e' || c == 'E' || c == '+')
+                is_integer = false;
+            else if (!(c >= '0' && c <= '9') && c != '-')
+                break;
+        }
+        if (begin == _p)
+            fail("unexpected character");
+
+        if (is_integer)
+        {
+            if (*begin == '-')
+            {
+                int64_t val;
+                auto res = from_chars(begin, _p, val);
+                if (res.ec == errc() && res.ptr == _p)
+                {
+                    _w << val;
+                    return;
+                }
+            }
+            else
+            {
+                uint64_t val;
+                auto res = from_chars(begin, _p, val);
+                if (res.ec == errc() && res.ptr == _p)
+                {
+                    _w << val;
+                    return;
+                }
+            }
+        }
+        double val;
+        auto res = from_chars(begin, _p, val);
+        if (res.ec != errc() || res.ptr != _p)
+        {
+            _p = begin;
+            fail("invalid number");
+        }
+        _w << val;
+    }
+
+    /// Write string starting right after the opening quote.
+    void write_string()
+    {
+        // find the closing quote, 8 bytes at a time
+        const char *begin = _p;
+        bool has_escapes = false;
+        for (;;)
+        {
+            while (_end - _p >= 8)
+            {
+                uint64_t v;
+                memcpy(&v, _p, 8);
+                if (needs_escape(v))
+                    break;
+                _p += 8;
+            }
+            if (_p == _end)
+                fail("unterminated string");
+            char c = *_p;
+            if (c == '"')
+                break;
+            if (c == '\\')
+            {
+                has_escapes = true;
+                _p += 2;
+                if (_p > _end)
+                    fail("unterminated string");
+                continue;
+            }
+            if (static_cast<uint8_t>(c) < 0x20)
+                fail("control character within string");
+            ++_p;
+        }
+        size_t raw_len = static_cast<size_t>(_p - begin);
+        ++_p; // closing quote
+
+        if (!has_escapes)
+        {
+            _w << string_view(begin, raw_len);
+            return;
+        }
+
+        // unescaped string is never longer than the raw one
+        _w.increment_container_counter();
+        _w.ensure(mp_sizeof_str(static_cast<uint32_t>(raw_len)));
+        char *head = _w.buf().end;
+        uint32_t reserved_header_size = mp_sizeof_strl(static_cast<uint32_t>(raw_len));
+        char *out = head + reserved_header_size;
+        char *body = out;
+        for (const char *s = begin, *s_end = begin + raw_len; s < s_end; )
+        {
+            if (*s != '\\')
+            {
+                *out++ = *s++;
+                continue;
+            }
+            ++s;
+            switch (*s++)
+            {
+            case '"':  *out++ = '"'; break;
+            case '\\': *out++ = '\\'; break;
+            case '/':  *out++ = '/'; break;
+            case 'b':  *out++ = '\b'; break;
+            case 'f':  *out++ = '\f'; break;
+            case 'n':  *out++ = '\n'; break;
+            case 'r':  *out++ = '\r'; break;
+            case 't':  *out++ = '\t'; break;
+            case 'u':
+            {
+                uint32_t code = decode_hex4(s, s_end);
+                if (code >= 0xD800 && code <= 0xDBFF && s_end - s >= 6 && s[0] == '\\' && s[1] == 'u')
+                {
+                    const char *low_pos = s + 2;
+                    uint32_t low = decode_hex4(low_pos, s_end);
+                    if (low >= 0xDC00 && low <= 0xDFFF)
+                    {
+                        code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+                        s = low_pos;
+                    }
+                }
+                out = encode_utf8(out, code);
+                break;
+            }
+            default:
+                _p = s - 1;
+                fail("invalid escape sequence");
+            }
+        }
+
+        uint32_t len = static_cast<uint32_t>(out - body);
+        uint32_t header_size = mp_sizeof_strl(len);
+        if (header_size != reserved_header_size)
+            memmove(head + header_size, body, len);
+        mp_encode_strl(head, len);
+        _w.buf().end = head + header_size + len;
+    }
+
+    uint32_t decode_hex4(const char *&s, const char *s_end)
+    {
+        if (s_end - s < 4)
+            fail("invalid unicode escape");
+        uint32_t code = 0;
+        for (int i = 0; i < 4; ++i, ++s)
+        {
+            char c = *s;
+            uint32_t half = c >= '0' && c <= '9' ? c - '0' :
+                            c >= 'a' && c <= 'f' ? c - 'a' + 10 :
+                            c >= 'A' && c <= 'F' ? c - 'A' + 10 : 0x10;
+            if (half > 0xF)
+                fail("invalid unicode escape");
+            code = (code << 4) | half;
+        }
+        return code;
+    }
+
+    static char* encode_utf8(char *out, uint32_t code) noexcept
+    {
+        if (code < 0x80)
+        {
+            *out++ = static_cast<char>(code);
+        }
+        else if (code < 0x800)
+        {
+            *out++ = static_cast<char>(0xC0 | (code >> 6));
+            *out++ = static_cast<char>(0x80 | (code & 0x3F));
+        }
+        else if (code < 0x10000)
+        {
+            *out++ = static_cast<char>(0xE0 | (code >> 12));
+            *out++ = static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+            *out++ = static_cast<char>(0x80 | (code & 0x3F));
+        }
+        else
+        {
+            *out++ = static_cast<char>(0xF0 | (code >> 18));
+            *out++ = static_cast<char>(0x80 | ((code >> 12) & 0x3F));
+            *out++ = static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+            *out++ = static_cast<char>(0x80 | (code & 0x3F));
+        }
+        return out;
+    }
+};
+
+} // namespace
+
+mp_writer& operator<<(mp_writer &w, const mp_json &json)
+{
+    auto state = w.get_state();
+    try
+    {
+        json_transcoder(w, json.text).run();
+    }
+    catch (...)
+    {
+        w.set_state(state);
+        throw;
+    }
+    return w;
+}
@@ -0,0 +1,90 @@
+#ifndef MP_JSON_H
+#define MP_JSON_H
+
+/** @file */
+
+#include <cstdint>
+#include <string_view>
+#include <vector>
+#include "fu2/function2.hpp"
+#include "mp_reader.h"
+#include "mp_writer.h"
+#include "wtf_buffer.h"
+
+/** Streaming MsgPack to JSON transcoder.
+ *
+ *  Writes JSON right into the output buffer, no intermediate strings are built.
+ *  Strings are escaped 8 bytes at a time, numbers are formatted with std::to_chars,
+ *  binary data goes as a base64 string, extensions are printed by mp_snprint
+ *  (see mp_initialize()). Non-string map keys are quoted (`{1: 2}` -> `{"1": 2}`),
+ *  NaN and infinity are written as null.
+ *
+ *  With a chunk handler set, the handler is called every time the output exceeds
+ *  the chunk size and must consume (and clear) the buffer, so responses of any size
+ *  are transcoded within a bounded buffer.
+ */
+class mp_json_writer
+{
+public:
+    using chunk_handler = fu2::unique_function<void(wtf_buffer &buf)>;
+
+    mp_json_writer(wtf_buffer &buf);
+    mp_json_writer(wtf_buffer &buf, size_t chunk_size, chunk_handler &&handler);
+
+    /// Transcode a single msgpack item.
+    mp_json_writer& operator<< (const mp_plain &item);
+
+    /// Transcode the next item of the reader and move its position to the following one.
+    template <typename MP>
+    mp_json_writer& operator<< (mp_reader<MP> &reader)
+    {
+        const char *begin = reader.pos();
+        reader.skip();
+        return *this << mp_plain{begin, reader.pos()};
+    }
+
+    /// Pass the rest of the output to the chunk handler (if any).
+    void flush();
+
+private:
+    struct container
+    {
+        uint32_t remaining;  ///< items left (map keys and values are counted separately)
+        bool is_map;
+    };
+
+    wtf_buffer &_buf;
+    size_t _chunk_size = 0;
+    chunk_handler _chunk_handler;
+    std::vector<container> _containers;
+
+    void ensure(size_t size);
+    void maybe_flush();
+    void put(char c) noexcept
+    {
+        *_buf.end++ = c;
+    }
+    void write_scalar(const char *&pos, bool is_key);
+    void write_string(const char *data, size_t size);
+    void write_base64(const char *data, size_t size);
+    void write_ext(const char *&pos);
+};
+
+/** JSON text to be transcoded into msgpack by mp_writer in a single pass,
+ *  e.g. `w.call("ingest", mp_json{http_body})`.
+ *
+ *  Containers are opened with 1-byte headers and resized within finalize(),
+ *  so only containers having more than 15 items are moved. Strings are scanned
+ *  8 bytes at a time and written without escapes right into the output buffer.
+ *  Integers are encoded as integers (if fit into 64 bits), other numbers as double.
+ */
+struct mp_json
+{
+    std::string_view text;
+};
+
+/// Transcode JSON into msgpack. Throws std::runtime_error on malformed JSON,
+/// the writer is rolled back to its initial state then.
+mp_writer& operator<< (mp_writer &w, const mp_json &json);
+
+#endif // MP_JSON_H
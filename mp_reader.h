@@ -1,13 +1,23 @@
 #pragma once
 
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cassert>
 #include <chrono>
 #include <cstddef>
+#include <cstring>
 #include <stdexcept>
 #include <optional>
 #include <vector>
 #include <map>
+#include <memory>
+#include <memory_resource>
+#include <unordered_map>
 #include <cmath>
 #include <charconv>
+#include <span>
+#include <utility>
 #include "msgpuck/ext_tnt.h"
 #include "msgpuck/msgpuck.h"
 #include "wtf_buffer.h"
@@ -82,6 +92,64 @@ inline std::string mpuck_type_name(mp_type type)
 template <typename MP>
 std::string hex_dump_mp(const MP &mp, const char *pos);
 
+/** Map key encoded into messagepack once (the shortest form, as tarantool
+ *  and mp_writer encode it), so keys are compared by memcmp instead of
+ *  decoding every key met. Keys encoded in a non-shortest form never match. */
+class mp_key
+{
+public:
+    template <typename T>
+        requires ((std::is_integral_v<T> || std::is_enum_v<T>) && !std::is_same_v<T, bool>)
+    explicit mp_key(T key)
+    {
+        using V = typename std::conditional_t<std::is_enum_v<T>, std::underlying_type<T>, std::type_identity<T>>::type;
+        auto val = static_cast<V>(key);
+        char buf[9];
+        char *end;
+        if constexpr (std::is_signed_v<V>)
+            end = val < 0 ? mp_encode_int(buf, val) : mp_encode_uint(buf, static_cast<uint64_t>(val));
+        else
+            end = mp_encode_uint(buf, val);
+        assign(buf, end);
+    }
+
+    explicit mp_key(std::string_view key)
+    {
+        _encoded.resize(mp_sizeof_str(key.size()));
+        mp_encode_str(_encoded.data(), key.data(), key.size());
+        _hash = std::hash<std::string_view>{}(_encoded);
+    }
+
+    /// Encoded key bytes.
+    std::string_view encoded() const noexcept
+    {
+        return _encoded;
+    }
+
+    /// Precomputed hash of encoded bytes (std::hash<std::string_view>).
+    size_t hash() const noexcept
+    {
+        return _hash;
+    }
+
+    /// Compare with the item [begin, end).
+    bool matches(const char *begin, const char *end) const noexcept
+    {
+        return static_cast<size_t>(end - begin) == _encoded.size() &&
+               std::memcmp(begin, _encoded.data(), _encoded.size()) == 0;
+    }
+
+private:
+    void assign(const char *begin, const char *end)
+    {
+        _encoded.assign(begin, end);
+        _hash = std::hash<std::string_view>{}(_encoded);
+    }
+
+    std::string _encoded;
+    size_t _hash = 0;
+};
+
 struct mp_plain
 {
     inline mp_plain(const wtf_buffer &buf) : mp_plain(buf.data(), buf.end) {}
@@ -114,6 +182,108 @@ public:
 #undef DLL_PUBLIC
 #undef DLL_LOCAL
 
+/// Error codes of exception-free reading (see mp_reader::try_read()).
+enum class mp_errc : uint8_t
+{
+    ok = 0,
+    no_data,        ///< no msgpack data to read
+    out_of_bounds,  ///< read out of bounds
+    invalid,        ///< invalid messagepack
+    type_mismatch,  ///< unexpected value type
+    overflow,       ///< value does not fit the destination
+    unsupported,    ///< unsupported conversion (e.g. ext value to a string)
+    no_memory       ///< the destination failed to allocate (std::string)
+};
+
+/** Result of mp_reader::try_read().
+ *
+ * Trivially copyable, holds no allocated data. A message is formatted
+ * only when explicitly requested.
+ */
+struct mp_read_status
+{
+    mp_errc code = mp_errc::ok;
+    mp_type expected = MP_NIL;  ///< requested type (type_mismatch only)
+    mp_type actual = MP_NIL;    ///< actual type (type_mismatch only)
+    mp_plain content;           ///< msgpack being read
+    const char *pos = nullptr;  ///< position of the failure
+
+    /// true if succeeded
+    explicit operator bool() const noexcept
+    {
+        return code == mp_errc::ok;
+    }
+
+    /// Format error message (the same mp_reader_error would have).
+    std::string message() const
+    {
+        return description() + '\n' + hex_dump_mp(content, pos);
+    }
+
+    /// Throw mp_reader_error if failed (std::bad_alloc for no_memory).
+    void throw_if_error() const
+    {
+        if (code == mp_errc::no_memory)
+            throw std::bad_alloc();
+        if (code != mp_errc::ok)
+            throw mp_reader_error(description(), content, pos);
+    }
+
+private:
+    std::string description() const
+    {
+        switch (code)
+        {
+        case mp_errc::ok:
+            return "ok";
+        case mp_errc::no_data:
+            return "no msgpack data to read";
+        case mp_errc::out_of_bounds:
+            return "read out of bounds";
+        case mp_errc::invalid:
+            return "invalid messagepack";
+        case mp_errc::type_mismatch:
+            return mpuck_type_name(expected) + " expected, got " + mpuck_type_name(actual);
+        case mp_errc::overflow:
+            return "value overflow";
+        case mp_errc::unsupported:
+            return "unsupported conversion from " + mpuck_type_name(actual);
+        case mp_errc::no_memory:
+            return "out of memory";
+        }
+        return "unknown error";
+    }
+};
+
+/// Value or error returned by mp_reader::try_read<T>().
+template <typename T>
+struct mp_expected
+{
+    T value{};
+    mp_read_status status;
+
+    explicit operator bool() const noexcept
+    {
+        return static_cast<bool>(status);
+    }
+    T& operator*() noexcept
+    {
+        return value;
+    }
+    const T& operator*() const noexcept
+    {
+        return value;
+    }
+    T* operator->() noexcept
+    {
+        return &value;
+    }
+    const T* operator->() const noexcept
+    {
+        return &value;
+    }
+};
+
 struct mp_array : public mp_plain
 {
     mp_array() = default;
@@ -245,6 +415,26 @@ struct mp_map : public mp_plain
     template <typename T>
     mp_plain find(const T &key) const;
 
+    /// Return mp_plain for a value with the specified precomputed key
+    /// (keys are compared bytewise). Returns empty mp_plain if the key is not found.
+    mp_plain find(const mp_key &key) const
+    {
+        auto pos = begin;
+        for (auto n = cardinality; n-- > 0;)
+        {
+            auto key_end = pos;
+            mp_next(&key_end);
+            auto value_end = key_end;
+            mp_next(&value_end);
+            if (end && value_end > end)
+                throw mp_reader_error("read out of bounds", *this, pos);
+            if (key.matches(pos, key_end))
+                return {key_end, value_end};
+            pos = value_end;
+        }
+        return {nullptr, nullptr};
+    }
+
     /// Return mp_plain for a value with the specified key.
     /// Throws if the key is not found.
     template <typename T>
@@ -259,6 +449,84 @@ struct mp_map : public mp_plain
     size_t cardinality = 0;
 };
 
+/** Map with the lookup index (hash of encoded key bytes -> value) built
+ *  on the first lookup: one pass over the map, then O(1) per find().
+ *  Pays off for large maps looked up repeatedly. The index refers to the
+ *  underlying buffer and is built lazily, so the instance must not be shared
+ *  between threads before the first find(). Duplicate keys: the first wins
+ *  (as with mp_map::find()). */
+class mp_indexed_map : public mp_map
+{
+public:
+    using mp_map::mp_map;
+    mp_indexed_map() = default;
+    mp_indexed_map(const mp_map &map) : mp_map(map) {}
+
+    /// Return mp_plain for a value with the specified key.
+    /// Returns empty mp_plain if the key is not found.
+    mp_plain find(const mp_key &key) const
+    {
+        if (!_indexed)
+            build_index();
+        auto it = _index.find(key);
+        return it == _index.end() ? mp_plain{nullptr, nullptr} : it->second;
+    }
+
+    template <typename T>
+    mp_plain find(const T &key) const
+    {
+        return find(mp_key(key));
+    }
+
+    /// Return mp_plain for a value with the specified key.
+    /// Throws if the key is not found.
+    template <typename T>
+    mp_plain operator[](const T &key) const
+    {
+        mp_plain res = find(key);
+        if (!res)
+            throw mp_reader_error("key not found", *this);
+        return res;
+    }
+
+private:
+    struct key_hash
+    {
+        using is_transparent = void;
+        size_t operator()(std::string_view key) const noexcept { return std::hash<std::string_view>{}(key); }
+        size_t operator()(const mp_key &key) const noexcept { return key.hash(); }
+    };
+
+    struct key_equal
+    {
+        using is_transparent = void;
+        bool operator()(std::string_view a, std::string_view b) const noexcept { return a == b; }
+        bool operator()(const mp_key &a, std::string_view b) const noexcept { return a.encoded() == b; }
+        bool operator()(std::string_view a, const mp_key &b) const noexcept { return a == b.encoded(); }
+    };
+
+    void build_index() const
+    {
+        _index.reserve(cardinality);
+        auto pos = begin;
+        for (auto n = cardinality; n-- > 0;)
+        {
+            auto key_end = pos;
+            mp_next(&key_end);
+            auto value_end = key_end;
+            mp_next(&value_end);
+            if (end && value_end > end)
+                throw mp_reader_error("read out of bounds", *this, pos);
+            _index.try_emplace(std::string_view{pos, static_cast<size_t>(key_end - pos)}, key_end, value_end);
+            pos = value_end;
+        }
+        _indexed = true;
+    }
+
+    mutable std::unordered_map<std::string_view, mp_plain, key_hash, key_equal> _index;
+    mutable bool _indexed = false;
+};
+
 template <size_t maxN>
 struct mp_span : public mp_array
 {
@@ -326,580 +594,2218 @@ struct mp_optional
     const T &def;
 };
 
-/// messagepack reader
-template<typename MP = mp_plain>
-class mp_reader
+/// Projection item for mp_reader::project(): field index (array) or key (map) and its destination.
+template <typename K, typename T>
+struct mp_at
 {
-    template<typename T>
-    friend class mp_reader;
+    /// The key is kept by value (C strings as views), so mp_at may outlive the key expression.
+    using key_type = std::conditional_t<std::is_array_v<K> || std::is_pointer_v<K>, std::string_view, K>;
 
-    static_assert(std::derived_from<MP, mp_plain>, "mp_reader operates on mp_plain and its descendants");
-protected:
-    MP _mp;
-    const char *_current_pos = nullptr;
-    uint32_t _current_ind = 0;
+    mp_at(const K &key, T &dst) : key(key), dst(dst) {}
+    key_type key;
+    T &dst;
+};
 
+/** Learned layout of maps sharing the same keys in the same order
+ *  (e.g. tables returned by the same lua function).
+ *
+ *  The first map is decoded as usual and its key bytes are remembered.
+ *  Subsequent maps with the same cardinality are verified by memcmp of keys
+ *  against the remembered ones and the values are taken by known pair numbers
+ *  (values still are skipped with mp_next() as their sizes vary). Pairs after
+ *  the last requested one are not examined at all. Any mismatch falls back
+ *  to the regular decoding and the shape is learned anew.
+ *  See mp_reader<mp_map>::project(mp_map_shape&, ...). */
+class mp_map_shape
+{
 public:
-    mp_reader(MP mp) : _mp(mp), _current_pos(_mp.begin) {}
-
-    mp_reader(const wtf_buffer &buf) : mp_reader(buf.data(), buf.end) {};
-    mp_reader(const std::vector<char> &buf) : mp_reader(buf.data(), buf.data() + buf.size()) {};
+    /// Fields (map keys) to extract.
+    template <typename... K>
+    explicit mp_map_shape(const K&... keys) : _fields{mp_key(keys)...} {}
 
-    template<typename ...Args>
-    mp_reader(Args... args) : _mp(args ...), _current_pos(_mp.begin)
+    /// Number of fields.
+    size_t size() const noexcept
     {
+        return _fields.size();
     }
 
-    MP content() const noexcept
+    /// Number of maps decoded via the regular (learning) path.
+    size_t misses() const noexcept
     {
-        return _mp;
+        return _misses;
     }
 
-    const char* begin() const noexcept
+    /** Locate values of the fields within `pairs` map pairs starting at `pos`
+     *  (`end` is optional right bound). `values` (one per field) receive
+     *  the values found and empty mp_plain for absent keys. `pos` is moved
+     *  right after the last examined pair. Returns the number of examined pairs. */
+    size_t locate(const char *&pos, const char *end, size_t pairs, std::span<mp_plain> values)
     {
-        return _mp.begin;
+        assert(values.size() == _fields.size());
+        if (_learned && _pairs == pairs)
+        {
+            const char *cur = pos;
+            const char *key = _keys.data();
+            size_t i = 0;
+            for (; i < _slots.size(); ++i)
+            {
+                auto &s = _slots[i];
+                if ((end && static_cast<size_t>(end - cur) < s.key_size) ||
+                    std::memcmp(cur, key, s.key_size) != 0)
+                    break;
+                key += s.key_size;
+                cur += s.key_size;
+                const char *value = cur;
+                mp_next(&cur);
+                if (end && cur > end)
+                    throw mp_reader_error("read out of bounds", mp_plain{pos, end}, value);
+                if (s.field != npos)
+                    values[s.field] = {value, cur};
+            }
+            if (i == _slots.size())
+            {
+                for (size_t f = 0; f < _fields.size(); ++f)
+                {
+                    if (!_found[f])
+                        values[f] = {};
+                }
+                pos = cur;
+                return _slots.size();
+            }
+        }
+        return learn(pos, end, pairs, values);
     }
 
-    const char* end() const noexcept
+private:
+    static constexpr uint32_t npos = UINT32_MAX;
+
+    struct slot
     {
-        return _mp.end;
-    }
+        uint32_t key_size;
+        uint32_t field;     ///< requested field number or npos
+    };
 
-    size_t size() const
+    size_t learn(const char *&pos, const char *end, size_t pairs, std::span<mp_plain> values)
     {
-        return _mp.end - _mp.begin;
+        ++_misses;
+        _learned = false;
+        _pairs = pairs;
+        _keys.clear();
+        _slots.clear();
+        _found.assign(_fields.size(), false);
+        std::fill(values.begin(), values.end(), mp_plain{});
+
+        const char *cur = pos;
+        size_t found_cnt = 0;
+        size_t examined = 0;
+        while (examined < pairs && found_cnt < _fields.size())
+        {
+            const char *key = cur;
+            mp_next(&cur);
+            const char *value = cur;
+            mp_next(&cur);
+            if (end && cur > end)
+                throw mp_reader_error("read out of bounds", mp_plain{pos, end}, key);
+            ++examined;
+
+            uint32_t field = npos;
+            for (size_t f = 0; f < _fields.size(); ++f)
+            {
+                if (!_found[f] && _fields[f].matches(key, value))
+                {
+                    field = static_cast<uint32_t>(f);
+                    _found[f] = true;
+                    values[f] = {value, cur};
+                    ++found_cnt;
+                    break;
+                }
+            }
+            _keys.append(key, value);
+            _slots.push_back({static_cast<uint32_t>(value - key), field});
+        }
+        _learned = true;
+        pos = cur;
+        return examined;
     }
 
-    const char* pos() const noexcept
+    std::vector<mp_key> _fields;
+    std::string _keys;          ///< learned key bytes in map order
+    std::vector<slot> _slots;   ///< learned pairs (up to the last requested one)
+    std::vector<bool> _found;   ///< fields present within learned shape
+    size_t _pairs = 0;          ///< learned map cardinality
+    size_t _misses = 0;
+    bool _learned = false;
+};
+
+template <typename>
+inline constexpr bool is_std_optional_v = false;
+template <typename T>
+inline constexpr bool is_std_optional_v<std::optional<T>> = true;
+
+/** Zero-copy string which keeps alive the buffer it refers to
+ *  (e.g. tnt::connection::input_batch()). Set `owner` before decoding:
+ *  `mp_string_view name{batch}; reader >> name;` */
+struct mp_string_view : public std::string_view
+{
+    mp_string_view() = default;
+    explicit mp_string_view(std::shared_ptr<const void> owner) : owner(std::move(owner)) {}
+
+    std::shared_ptr<const void> owner;
+};
+
+/** Typed zero-copy tuple view which keeps alive the buffer it refers to.
+ *  `Ts` may contain std::string_view, mp_plain, readers and so on:
+ *  they remain valid as long as the view exists.
+ *  Set the owner before decoding: `mp_tuple_view<int, std::string_view> t{batch}; reader >> t;` */
+template <typename... Ts>
+class mp_tuple_view
+{
+public:
+    mp_tuple_view() = default;
+    explicit mp_tuple_view(std::shared_ptr<const void> owner) : _owner(std::move(owner)) {}
+
+    template <size_t I>
+    const auto& get() const noexcept
     {
-        return _current_pos;
+        return std::get<I>(_values);
     }
 
-    uint32_t ind() const noexcept
+    const std::tuple<Ts...>& values() const noexcept
     {
-        return _current_ind;
+        return _values;
     }
 
-    /// Cardinality of the array or map.
-    size_t cardinality() const noexcept
-        requires (std::is_same<MP, mp_array>::value || std::is_same<MP, mp_map>::value)
+    /// Encoded tuple.
+    mp_plain raw() const noexcept
     {
-        return _mp.cardinality;
+        return _raw;
     }
 
-    /// Skip current encoded item (in case of array/map skips all its elements).
-    mp_reader& skip()
+    const std::shared_ptr<const void>& owner() const noexcept
     {
-        if (!_current_pos || (_mp.end && _current_pos >= _mp.end))
-            throw mp_reader_error("read out of bounds", _mp, _mp.end);
+        return _owner;
+    }
 
-        if constexpr (requires {_mp.cardinality;})
-        {
-            size_t c = _mp.cardinality;
-            if constexpr (std::is_same<MP, mp_map>::value)
-                c = c * 2;
-            if (_current_ind >= c)
-                throw mp_reader_error("read out of bounds", _mp, _current_pos);
-        }
+private:
+    template <typename MP>
+    friend class mp_reader;
 
-        const char *prev = _current_pos;
-        mp_next(&_current_pos);
-        if (_mp.end && _current_pos > _mp.end)
-        {
-            _current_pos = prev;
-            throw mp_reader_error("invalid messagepack", _mp, prev);
-        }
-        ++_current_ind;
-        return *this;
-    }
+    std::shared_ptr<const void> _owner;
+    mp_plain _raw;
+    std::tuple<Ts...> _values;
+};
 
-    /// Skip current encoded item and ensure it has expected type.
-    mp_reader& skip(mp_type type, bool nullable = false)
+/// Numeric types decoded in bulk (see mp_reader::read_numeric()).
+template <typename T>
+inline constexpr bool mp_bulk_numeric_v =
+    std::is_floating_point_v<T> ||
+    (std::is_integral_v<T> && sizeof(T) < 16 &&
+     !std::is_same_v<T, bool> && !std::is_same_v<T, char> && !std::is_same_v<T, wchar_t> &&
+     !std::is_same_v<T, char8_t> && !std::is_same_v<T, char16_t> && !std::is_same_v<T, char32_t>);
+
+/// Construct a value to decode into std::optional destination:
+/// allocator-aware types inherit the allocator of the current value (if any).
+template <typename T>
+T mp_make_like(const std::optional<T> &val)
+{
+    if constexpr (requires { val->get_allocator(); })
     {
-        if (!_current_pos)
-            throw std::runtime_error("no msgpack data to read");
-        auto actual_type = mp_typeof(*_current_pos);
-        if (actual_type != type && (!nullable || actual_type != MP_NIL))
-            throw mp_reader_error(mpuck_type_name(type) + " expected, got " + mpuck_type_name(actual_type), _mp, _current_pos);
-        return skip();
+        if (val)
+            return std::make_obj_using_allocator<T>(val->get_allocator());
     }
+    return T{};
+}
 
-    /// Return current encoded iproto message (header + body) within separate reader
-    /// and move current position to next item.
-    mp_reader iproto_message()
-    {
-        if (_mp.end - _current_pos < 5)
-            return {_current_pos, _current_pos}; // empty object
+/** Tarantool MP_EXT value decoded into a plain struct (no allocation):
+ *  `static constexpr int8_t ext_type`, `decode()` of the ext payload,
+ *  `payload_size()` and `encode_payload()` for mp_writer. */
+template <typename T>
+concept mp_ext_value = requires(const T &val, T &dst, const char *src, char *dst_buf)
+{
+    { T::ext_type } -> std::convertible_to<int8_t>;
+    { T::decode(src, uint32_t{}, dst) } -> std::same_as<bool>;
+    { val.payload_size() } -> std::same_as<uint32_t>;
+    { val.encode_payload(dst_buf) } -> std::same_as<char*>;
+};
 
-        if (static_cast<uint8_t>(*_current_pos) != 0xce)
-            throw mp_reader_error("invalid iproto packet", _mp);
+/// MP_DECIMAL as fixed-point value: mantissa * 10^-scale (up to 38 significant digits).
+struct mp_decimal
+{
+    static constexpr int8_t ext_type = MP_DECIMAL;
+    static constexpr int max_digits = 38;
 
-        uint64_t response_size = mp_decode_uint(&_current_pos);
-        if (static_cast<uint64_t>(_mp.end - _current_pos) < response_size)
-            throw mp_reader_error("partial iproto packet", _mp);
+    __int128 mantissa = 0;
+    int32_t scale = 0;
 
-        auto head = _current_pos;
-        _current_pos += response_size;
-        return mp_reader{mp_plain{head, _current_pos}};
+    /// Representations are compared (1.0 != 1.00).
+    bool operator==(const mp_decimal&) const = default;
+
+    /// Correctly rounded conversion (via text representation, no allocation).
+    double to_double() const noexcept
+    {
+        char tmp[64];
+        char *end = tmp + sizeof(tmp);
+        char *p = end;
+        unsigned __int128 abs = mantissa < 0 ? -static_cast<unsigned __int128>(mantissa) : static_cast<unsigned __int128>(mantissa);
+        do
+        {
+            *--p = static_cast<char>('0' + abs % 10);
+            abs /= 10;
+        } while (abs);
+        if (mantissa < 0)
+            *--p = '-';
+        // "<digits>e<-scale>"
+        std::memmove(tmp, p, static_cast<size_t>(end - p));
+        end = tmp + (end - p);
+        *end++ = 'e';
+        end = std::to_chars(end, tmp + sizeof(tmp), -static_cast<int64_t>(scale)).ptr;
+        double res = 0;
+        std::from_chars(tmp, end, res);
+        return res;
     }
 
-    /// Extract and serialize value to string (nil -> 'null') and move current position to next item.
-    std::string to_string(uint32_t flags = 0)
+    /// Decode ext payload (scale + packed BCD). Returns false if malformed.
+    static bool decode(const char *data, uint32_t len, mp_decimal &val) noexcept
     {
-        const char *data = _current_pos;
-        skip();
+        const char *end = data + len;
+        const char *tmp = data;
+        auto type = data < end ? mp_typeof(*data) : MP_NIL;
+        if ((type != MP_UINT && type != MP_INT) || mp_check(&tmp, end))
+            return false;
+        int64_t scale = type == MP_UINT ? static_cast<int64_t>(mp_decode_uint(&data)) : mp_decode_int(&data);
+        if (scale > std::numeric_limits<int32_t>::max() || scale < std::numeric_limits<int32_t>::min() || data == end)
+            return false;
 
-        std::string res(256, '\0');
-        int cnt = mp_snprint(res.data(), static_cast<int>(res.size()), data, flags);
-        if (cnt >= static_cast<int>(res.size()))
+        unsigned __int128 abs = 0;
+        int digits = 0;
+        for (const char *p = data; p < end; ++p)
         {
-            res.resize(static_cast<size_t>(cnt + 1));
-            cnt = mp_snprint(res.data(), static_cast<int>(res.size()), data, flags);
+            uint8_t byte = static_cast<uint8_t>(*p);
+            uint8_t nibbles[2] = {static_cast<uint8_t>(byte >> 4), static_cast<uint8_t>(byte & 0x0F)};
+            for (int i = 0; i < 2; ++i)
+            {
+                if (p == end - 1 && i == 1) // sign
+                {
+                    if (nibbles[1] < 0x0A)
+                        return false;
+                    val.mantissa = nibbles[1] == 0x0B || nibbles[1] == 0x0D ?
+                                   -static_cast<__int128>(abs) : static_cast<__int128>(abs);
+                    val.scale = static_cast<int32_t>(scale);
+                    return true;
+                }
+                if (nibbles[i] > 9 || (digits += (abs || nibbles[i])) > max_digits)
+                    return false;
+                abs = abs * 10 + nibbles[i];
+            }
         }
-        if (cnt < 0)
-            throw mp_reader_error("mp_snprint error", _mp, data);
-        res.resize(static_cast<size_t>(cnt));
-        return res;
+        return false;
     }
 
-    /// Validate next MsgPack item and check right bound if known
-    inline void check_next() const
+    uint32_t payload_size() const noexcept
     {
-        if (!_current_pos)
-            return;
-        if (!_mp.end)
-            throw mp_reader_error("right bound is not specified", _mp);
-
-        if (_current_pos >= _mp.end)
-            throw mp_reader_error("read out of bounds", _mp, _current_pos);
-        auto pos = _current_pos;
-        if (mp_check(&pos, _mp.end))
-            throw mp_reader_error("invalid messagepack", _mp, _current_pos);
+        return scale_size() + (digit_count() + 2) / 2;
     }
 
-    /// Validate MsgPack within current buffer (all items)
-    void check() const
+    char* encode_payload(char *dst) const noexcept
     {
-        if (!_mp.begin)
-            return;
-        if (!_mp.end)
-            throw mp_reader_error("right bound is not specified", *this);
-        auto pos = _mp.begin;
-        while (pos < _mp.end)
-        {
-            const char *prev = pos;
-            if (mp_check(&pos, _mp.end))
-                throw mp_reader_error("invalid messagepack", *this, prev);
-        }
+        dst = scale < 0 ? mp_encode_int(dst, scale) : mp_encode_uint(dst, static_cast<uint64_t>(scale));
+        int digits = digit_count();
+        int bytes = (digits + 2) / 2;
+        unsigned __int128 abs = mantissa < 0 ? -static_cast<unsigned __int128>(mantissa) : static_cast<unsigned __int128>(mantissa);
+        // fill nibbles from the end: sign, then digits from the least significant one
+        std::fill_n(dst, bytes, 0);
+        int nibble = bytes * 2 - 1;
+        auto put = [dst](int nibble, uint8_t value) {
+            dst[nibble / 2] = static_cast<char>(dst[nibble / 2] | (nibble & 1 ? value : value << 4));
+        };
+        put(nibble--, mantissa < 0 ? 0x0D : 0x0C);
+        for (int i = 0; i < digits; ++i, abs /= 10)
+            put(nibble--, static_cast<uint8_t>(abs % 10));
+        return dst + bytes;
     }
 
-    /// Reset the current reading position back to the beginning.
-    void rewind() noexcept
+private:
+    uint32_t scale_size() const noexcept
     {
-        _current_pos = _mp.begin;
-        _current_ind = 0;
+        return scale < 0 ? mp_sizeof_int(scale) : mp_sizeof_uint(static_cast<uint64_t>(scale));
     }
 
-    /// Return true if the current value is `nil`.
-    bool is_null() const
+    int digit_count() const noexcept
     {
-        if (!has_next())
-            throw mp_reader_error("read out of bounds", _mp, _current_pos);
-
-        return mp_typeof(*_current_pos) == MP_NIL;
+        unsigned __int128 abs = mantissa < 0 ? -static_cast<unsigned __int128>(mantissa) : static_cast<unsigned __int128>(mantissa);
+        int digits = 1;
+        while (abs >= 10)
+        {
+            abs /= 10;
+            ++digits;
+        }
+        return digits;
     }
+};
 
-    /// Returns `true` if msgpack has more values to read. Pass `true` as an argument to throw an exception
-    /// when the possibility is unknown.
-    bool has_next(bool strict = false) const
+/// MP_UUID (bytes in RFC 4122 order).
+struct mp_uuid
+{
+    static constexpr int8_t ext_type = MP_UUID;
+
+    std::array<uint8_t, 16> bytes{};
+
+    bool operator==(const mp_uuid&) const = default;
+
+    static bool decode(const char *data, uint32_t len, mp_uuid &val) noexcept
     {
-        if (_mp.end)
-            return _current_pos && _current_pos < _mp.end;
-        else if (!_mp.begin)
+        if (len != val.bytes.size())
             return false;
-        if constexpr (requires {_mp.cardinality;})
-        {
-            if constexpr (std::is_same<MP, mp_map>::value)
-                return _current_pos && _current_ind < _mp.cardinality * 2;
-            else
-                return _current_pos && _current_ind < _mp.cardinality;
-        }
-
-        // allow to read at one's risk
-        if (!strict)
-            return true;
-        throw mp_reader_error("unable to determine if next value exists - no right bound specified",
-                              _mp, _current_pos);
+        memcpy(val.bytes.data(), data, len);
+        return true;
     }
 
-    /// true if not empty
-    operator bool() const noexcept
+    uint32_t payload_size() const noexcept
     {
-        return _mp;
-        /*if (_mp.end)
-            return _mp.begin && _mp.end > _mp.begin;
-        if constexpr (requires {_mp.cardinality;})
-            return _mp.begin && _mp.cardinality;
-        return false;*/
+        return static_cast<uint32_t>(bytes.size());
     }
 
-    /// Returns reader for a value with the specified index.
-    /// Current parsing position stays unchanged. Throws if the specified index is out of bounds.
-    mp_reader<mp_plain> operator[](size_t ind) const
-        requires (!std::is_same<MP, mp_map>::value)
+    char* encode_payload(char *dst) const noexcept
     {
-        if constexpr (requires {_mp.rbounds;})
-            return {_mp[ind]};
+        memcpy(dst, bytes.data(), bytes.size());
+        return dst + bytes.size();
+    }
+};
 
-        size_t i = 0;
-        auto tmp = *this;
-        if (_current_ind <= ind)
-            i = _current_ind;
-        else
-            tmp.rewind();
+/// MP_DATETIME: seconds since epoch, nanoseconds, timezone offset (minutes) and index.
+struct mp_datetime
+{
+    static constexpr int8_t ext_type = MP_DATETIME;
 
-        for (; i < ind; ++i)
-            tmp.skip();
+    int64_t epoch = 0;
+    int32_t nsec = 0;
+    int16_t tzoffset = 0;
+    int16_t tzindex = 0;
 
-        auto begin = tmp._current_pos;
-        tmp.skip();
-        return {mp_plain{begin, tmp._current_pos}};
-    }
+    bool operator==(const mp_datetime&) const = default;
 
-    /// Return `mp_reader<mp_plain>` for a value with the specified key.
-    /// Current parsing position stays unchanged. Throws if the key is not found.
-    template <typename T>
-    mp_reader<mp_plain> operator[](const T &key) const
-        requires (std::is_same<MP, mp_map>::value)
+    static bool decode(const char *data, uint32_t len, mp_datetime &val) noexcept
     {
-        return {_mp[key]};
+        if (len != sizeof(int64_t) && len != 2 * sizeof(int64_t))
+            return false;
+        memcpy(&val.epoch, data, sizeof(val.epoch));
+        val.nsec = val.tzoffset = val.tzindex = 0;
+        if (len != sizeof(int64_t))
+        {
+            data += sizeof(val.epoch);
+            memcpy(&val.nsec, data, sizeof(val.nsec));
+            memcpy(&val.tzoffset, data + sizeof(val.nsec), sizeof(val.tzoffset));
+            memcpy(&val.tzindex, data + sizeof(val.nsec) + sizeof(val.tzoffset), sizeof(val.tzindex));
+        }
+        return true;
     }
 
-    template <typename T>
-    mp_reader<mp_plain> find(const T &key) const
-        requires (std::is_same<MP, mp_map>::value)
+    uint32_t payload_size() const noexcept
     {
-        return {_mp.find(key)};
+        return nsec || tzoffset || tzindex ? 2 * sizeof(int64_t) : sizeof(int64_t);
     }
 
-    mp_reader& operator>> (std::string &val)
+    char* encode_payload(char *dst) const noexcept
     {
-        if (!_current_pos)
-            throw std::runtime_error("no msgpack data to read");
+        memcpy(dst, &epoch, sizeof(epoch));
+        dst += sizeof(epoch);
+        if (payload_size() == sizeof(int64_t))
+            return dst;
+        memcpy(dst, &nsec, sizeof(nsec));
+        memcpy(dst + sizeof(nsec), &tzoffset, sizeof(tzoffset));
+        memcpy(dst + sizeof(nsec) + sizeof(tzoffset), &tzindex, sizeof(tzindex));
+        return dst + sizeof(int64_t);
+    }
+};
 
-        if (mp_typeof(*_current_pos) == MP_EXT)
+/// MP_INTERVAL: datetime interval fields (see FIELD_YEAR and so on).
+struct mp_interval
+{
+    static constexpr int8_t ext_type = MP_INTERVAL;
+
+    /// Day adjustment on month arithmetic.
+    enum class adjust_mode : int64_t { excess = 0, limit = 1, snap = 2 };
+
+    int64_t year = 0;
+    int64_t month = 0;
+    int64_t week = 0;
+    int64_t day = 0;
+    int64_t hour = 0;
+    int64_t minute = 0;
+    int64_t second = 0;
+    int64_t nanosecond = 0;
+    adjust_mode adjust = adjust_mode::limit; ///< Tarantool's default ("none")
+
+    bool operator==(const mp_interval&) const = default;
+
+    static bool decode(const char *data, uint32_t len, mp_interval &val) noexcept
+    {
+        const char *end = data + len;
+        val = mp_interval{};
+        if (data == end)
+            return false;
+        uint8_t count = static_cast<uint8_t>(*data++);
+        for (uint8_t i = 0; i < count; ++i)
         {
-            // regular print
-            if (val.size() < 128)
-                val.resize(128, '\0');
-            size_t len = mp_snprint(val.data(), val.size(), _current_pos, UNQUOTE_UUID);
-            if (len > val.size())
+            if (data == end)
+                return false;
+            uint8_t field = static_cast<uint8_t>(*data++);
+            const char *tmp = data;
+            auto type = data < end ? mp_typeof(*data) : MP_NIL;
+            if ((type != MP_UINT && type != MP_INT) || mp_check(&tmp, end) || field > FIELD_ADJUST)
+                return false;
+            int64_t value;
+            if (type == MP_UINT)
             {
-                val.resize(len + 1, '\0');
-                len = mp_snprint(val.data(), len + 1, _current_pos, UNQUOTE_UUID);
+                uint64_t u = mp_decode_uint(&data);
+                if (u > static_cast<uint64_t>(std::numeric_limits<int64_t>::max()))
+                    return false;
+                value = static_cast<int64_t>(u);
             }
-            if (len < 0)
-                throw mp_reader_error("bad ext value content", _mp, _current_pos);
-            val.resize(len);
-            skip();
-        }
-        else
-        {
-            std::string_view tmp;
-            *this >> tmp;
-            if (!tmp.data())
-                throw mp_reader_error("string expected, got no data", _mp);
-            val.assign(tmp.data(), tmp.size());
+            else
+            {
+                value = mp_decode_int(&data);
+            }
+            if (field == FIELD_ADJUST)
+                val.adjust = static_cast<adjust_mode>(value);
+            else
+                *val.fields()[field] = value;
         }
-        return *this;
+        return data == end;
     }
 
-    mp_reader& operator>> (std::string_view &val)
+    uint32_t payload_size() const noexcept
     {
-        // for the sake of convenience
-        if (!has_next())
-        {
-            val = {};
-            return *this;
-        }
+        uint32_t size = 1 + 1 + value_size(static_cast<int64_t>(adjust)); // count + adjust (always encoded)
+        for (auto field : fields())
+            if (*field)
+                size += 1 + value_size(*field);
+        return size;
+    }
 
-        auto type = mp_typeof(*_current_pos);
-        if (type == MP_STR)
-        {
-            const char *prev = _current_pos;
-            uint32_t len = 0;
-            skip();
-            const char *value = mp_decode_str(&prev, &len);
-            val = {value, len};
-        }
-        else if (type == MP_NIL)
-        {
-            skip();
-            val = {}; // data() == nullptr
-        }
-        else
+    char* encode_payload(char *dst) const noexcept
+    {
+        auto fields = this->fields();
+        char *count = dst++;
+        *count = 0;
+        for (size_t i = 0; i < fields.size(); ++i)
         {
-            throw mp_reader_error("string expected, got " + mpuck_type_name(type), _mp, _current_pos);
+            if (!*fields[i])
+                continue;
+            ++*count;
+            *dst++ = static_cast<char>(i);
+            dst = encode_value(dst, *fields[i]);
         }
-        return *this;
+        ++*count;
+        *dst++ = FIELD_ADJUST;
+        return encode_value(dst, static_cast<int64_t>(adjust));
     }
 
-    mp_reader& operator>> (bool &val)
+private:
+    /// Fields in order of their ids (FIELD_YEAR ... FIELD_NANOSECOND).
+    std::array<int64_t*, FIELD_ADJUST> fields() noexcept
     {
-        if (!_current_pos)
-            throw std::runtime_error("no msgpack data to read");
-        const char *data = _current_pos;
-        auto type = mp_typeof(*data);
-        if (type != MP_BOOL)
-            throw mp_reader_error("boolean expected, got " + mpuck_type_name(type), _mp, _current_pos);
-
-        val = mp_decode_bool(&data);
-        skip();
-        return *this;
+        return {&year, &month, &week, &day, &hour, &minute, &second, &nanosecond};
     }
-
-    /// Use `>> mp_none()` to skip a value or `>> mp_none<N>()` to skip N items
-    template<size_t N = 1>
-    mp_reader& operator>> (mp_none<N>)
+    std::array<const int64_t*, FIELD_ADJUST> fields() const noexcept
     {
-        for (int i = 0; i < N; ++i)
-            skip();
-        return *this;
+        return {&year, &month, &week, &day, &hour, &minute, &second, &nanosecond};
     }
 
-    template<size_t maxN>
-    mp_reader& operator>> (mp_span<maxN> &dst)
+    static uint32_t value_size(int64_t value) noexcept
     {
-        dst.begin = _current_pos;
-        for (size_t i = 0; i < maxN && has_next(); ++i)
-        {
-            skip();
-            dst.rbounds[i] = _current_pos - dst.begin;
-            ++dst.cardinality;
-        }
-        dst.end = _current_pos;
-        return *this;
+        return value < 0 ? mp_sizeof_int(value) : mp_sizeof_uint(static_cast<uint64_t>(value));
     }
 
-    template <typename C, typename D>
-    mp_reader& operator>> (std::chrono::time_point<C, D> &val)
+    static char* encode_value(char *dst, int64_t value) noexcept
     {
-        if (!_current_pos)
-            throw std::runtime_error("no msgpack data to read");
-        using namespace std::chrono;
-        auto type = mp_typeof(*_current_pos);
-        switch (type) {
-        case MP_UINT:
-        case MP_INT:
-            val = time_point<C, D>(D(read<int64_t>()));
-            break;
-        case MP_FLOAT:
-        case MP_DOUBLE:
-            val = time_point<C, D>(D(read<double>()));
-            break;
-        case MP_EXT:
-        {
-            struct tmp {
-                int32_t nsec;
-                int16_t tzoffset;
-                int16_t tzindex;
-            } tail = {0, 0, 0};
+        return value < 0 ? mp_encode_int(dst, value) : mp_encode_uint(dst, static_cast<uint64_t>(value));
+    }
+};
 
-            int8_t ext_type;
-            const char *data = _current_pos;
-            uint32_t len = mp_decode_extl(&data, &ext_type);
+/// messagepack reader
+template<typename MP = mp_plain>
+class mp_reader
+{
+    template<typename T>
+    friend class mp_reader;
 
-            if (ext_type != MP_DATETIME)
-                throw mp_reader_error("unable to extract time_point from " + mpuck_type_name(type), _mp, data);
-            if (len != sizeof(int64_t) && len != sizeof(int64_t) + sizeof(tail))
-                throw mp_reader_error("unexpected MP_DATETIME value", _mp, data);
+    static_assert(std::derived_from<MP, mp_plain>, "mp_reader operates on mp_plain and its descendants");
+protected:
+    MP _mp;
+    const char *_current_pos = nullptr;
+    uint32_t _current_ind = 0;
 
-            int64_t epoch;
-            memcpy(&epoch, data, sizeof(epoch));
-            data += sizeof(epoch);
+public:
+    mp_reader(MP mp) : _mp(mp), _current_pos(_mp.begin) {}
 
-            if (len != sizeof(int64_t))
-                memcpy(&tail, data, sizeof(tail));
+    mp_reader(const wtf_buffer &buf) : mp_reader(buf.data(), buf.end) {};
+    mp_reader(const std::vector<char> &buf) : mp_reader(buf.data(), buf.data() + buf.size()) {};
 
-            if (tail.nsec)
-                val = time_point<C, D>(duration<int64_t, std::nano>(tail.nsec + epoch*1000000000));
-            else
-                val = time_point<C, D>(duration<int64_t>(epoch));
-            skip();
-            break;
-        }
-        default:
-            throw mp_reader_error("unable to get time_point from " + mpuck_type_name(type), _mp, _current_pos);
-        }
+    template<typename ...Args>
+    mp_reader(Args... args) : _mp(args ...), _current_pos(_mp.begin)
+    {
+    }
 
-        return *this;
+    MP content() const noexcept
+    {
+        return _mp;
     }
 
-    template <typename T>
-    mp_reader& operator>> (std::optional<T> &val)
+    const char* begin() const noexcept
     {
-        if (!has_next(true))
-        {
-            val = std::nullopt;
-        }
+        return _mp.begin;
+    }
+
+    const char* end() const noexcept
+    {
+        return _mp.end;
+    }
+
+    size_t size() const
+    {
+        return _mp.end - _mp.begin;
+    }
+
+    const char* pos() const noexcept
+    {
+        return _current_pos;
+    }
+
+    uint32_t ind() const noexcept
+    {
+        return _current_ind;
+    }
+
+    /// Cardinality of the array or map.
+    size_t cardinality() const noexcept
+        requires (std::is_same<MP, mp_array>::value || std::is_same<MP, mp_map>::value)
+    {
+        return _mp.cardinality;
+    }
+
+    /// Skip current encoded item (in case of array/map skips all its elements).
+    mp_reader& skip()
+    {
+        if (!_current_pos || (_mp.end && _current_pos >= _mp.end))
+            throw mp_reader_error("read out of bounds", _mp, _mp.end);
+
+        if constexpr (requires {_mp.cardinality;})
+        {
+            size_t c = _mp.cardinality;
+            if constexpr (std::is_same<MP, mp_map>::value)
+                c = c * 2;
+            if (_current_ind >= c)
+                throw mp_reader_error("read out of bounds", _mp, _current_pos);
+        }
+
+        const char *prev = _current_pos;
+        mp_next(&_current_pos);
+        if (_mp.end && _current_pos > _mp.end)
+        {
+            _current_pos = prev;
+            throw mp_reader_error("invalid messagepack", _mp, prev);
+        }
+        ++_current_ind;
+        return *this;
+    }
+
+    /// Skip `n` encoded items at once (bounds are checked against the right bound only).
+    mp_reader& skip(size_t n)
+    {
+        if (!n)
+            return *this;
+        if (!_current_pos || (_mp.end && _current_pos >= _mp.end))
+            throw mp_reader_error("read out of bounds", _mp, _mp.end);
+
+        if constexpr (requires {_mp.cardinality;})
+        {
+            size_t c = _mp.cardinality;
+            if constexpr (std::is_same<MP, mp_map>::value)
+                c = c * 2;
+            if (_current_ind + n > c)
+                throw mp_reader_error("read out of bounds", _mp, _current_pos);
+        }
+
+        const char *prev = _current_pos;
+        for (size_t i = 0; i < n; ++i)
+        {
+            if (_mp.end && _current_pos >= _mp.end)
+            {
+                _current_pos = prev;
+                throw mp_reader_error("read out of bounds", _mp, _mp.end);
+            }
+            mp_next(&_current_pos);
+            if (_mp.end && _current_pos > _mp.end)
+            {
+                _current_pos = prev;
+                throw mp_reader_error("invalid messagepack", _mp, prev);
+            }
+        }
+        _current_ind += static_cast<uint32_t>(n);
+        return *this;
+    }
+
+    /// Skip current encoded item and ensure it has expected type.
+    mp_reader& skip(mp_type type, bool nullable = false)
+    {
+        if (!_current_pos)
+            throw std::runtime_error("no msgpack data to read");
+        auto actual_type = mp_typeof(*_current_pos);
+        if (actual_type != type && (!nullable || actual_type != MP_NIL))
+            throw mp_reader_error(mpuck_type_name(type) + " expected, got " + mpuck_type_name(actual_type), _mp, _current_pos);
+        return skip();
+    }
+
+    /// Return current encoded iproto message (header + body) within separate reader
+    /// and move current position to next item.
+    mp_reader iproto_message()
+    {
+        if (_mp.end - _current_pos < 5)
+            return {_current_pos, _current_pos}; // empty object
+
+        if (static_cast<uint8_t>(*_current_pos) != 0xce)
+            throw mp_reader_error("invalid iproto packet", _mp);
+
+        uint64_t response_size = mp_decode_uint(&_current_pos);
+        if (static_cast<uint64_t>(_mp.end - _current_pos) < response_size)
+            throw mp_reader_error("partial iproto packet", _mp);
+
+        auto head = _current_pos;
+        _current_pos += response_size;
+        return mp_reader{mp_plain{head, _current_pos}};
+    }
+
+    /// Extract and serialize value to string (nil -> 'null') and move current position to next item.
+    std::string to_string(uint32_t flags = 0)
+    {
+        const char *data = _current_pos;
+        skip();
+
+        std::string res(256, '\0');
+        int cnt = mp_snprint(res.data(), static_cast<int>(res.size()), data, flags);
+        if (cnt >= static_cast<int>(res.size()))
+        {
+            res.resize(static_cast<size_t>(cnt + 1));
+            cnt = mp_snprint(res.data(), static_cast<int>(res.size()), data, flags);
+        }
+        if (cnt < 0)
+            throw mp_reader_error("mp_snprint error", _mp, data);
+        res.resize(static_cast<size_t>(cnt));
+        return res;
+    }
+
+    /// Validate next MsgPack item and check right bound if known
+    inline void check_next() const
+    {
+        if (!_current_pos)
+            return;
+        if (!_mp.end)
+            throw mp_reader_error("right bound is not specified", _mp);
+
+        if (_current_pos >= _mp.end)
+            throw mp_reader_error("read out of bounds", _mp, _current_pos);
+        auto pos = _current_pos;
+        if (mp_check(&pos, _mp.end))
+            throw mp_reader_error("invalid messagepack", _mp, _current_pos);
+    }
+
+    /// Validate MsgPack within current buffer (all items)
+    void check() const
+    {
+        if (!_mp.begin)
+            return;
+        if (!_mp.end)
+            throw mp_reader_error("right bound is not specified", _mp);
+        auto pos = _mp.begin;
+        while (pos < _mp.end)
+        {
+            const char *prev = pos;
+            if (mp_check(&pos, _mp.end))
+                throw mp_reader_error("invalid messagepack", _mp, prev);
+        }
+    }
+
+    /// Reset the current reading position back to the beginning.
+    void rewind() noexcept
+    {
+        _current_pos = _mp.begin;
+        _current_ind = 0;
+    }
+
+    /// Return true if the current value is `nil`.
+    bool is_null() const
+    {
+        if (!has_next())
+            throw mp_reader_error("read out of bounds", _mp, _current_pos);
+
+        return mp_typeof(*_current_pos) == MP_NIL;
+    }
+
+    /// Returns `true` if msgpack has more values to read. Pass `true` as an argument to throw an exception
+    /// when the possibility is unknown.
+    bool has_next(bool strict = false) const
+    {
+        if (_mp.end)
+            return _current_pos && _current_pos < _mp.end;
+        else if (!_mp.begin)
+            return false;
+        if constexpr (requires {_mp.cardinality;})
+        {
+            if constexpr (std::is_same<MP, mp_map>::value)
+                return _current_pos && _current_ind < _mp.cardinality * 2;
+            else
+                return _current_pos && _current_ind < _mp.cardinality;
+        }
+
+        // allow to read at one's risk
+        if (!strict)
+            return true;
+        throw mp_reader_error("unable to determine if next value exists - no right bound specified",
+                              _mp, _current_pos);
+    }
+
+    /// true if not empty
+    operator bool() const noexcept
+    {
+        return _mp;
+        /*if (_mp.end)
+            return _mp.begin && _mp.end > _mp.begin;
+        if constexpr (requires {_mp.cardinality;})
+            return _mp.begin && _mp.cardinality;
+        return false;*/
+    }
+
+    /// Returns reader for a value with the specified index.
+    /// Current parsing position stays unchanged. Throws if the specified index is out of bounds.
+    mp_reader<mp_plain> operator[](size_t ind) const
+        requires (!std::is_same<MP, mp_map>::value)
+    {
+        if constexpr (requires {_mp.rbounds;})
+            return {_mp[ind]};
+
+        size_t i = 0;
+        auto tmp = *this;
+        if (_current_ind <= ind)
+            i = _current_ind;
+        else
+            tmp.rewind();
+
+        for (; i < ind; ++i)
+            tmp.skip();
+
+        auto begin = tmp._current_pos;
+        tmp.skip();
+        return {mp_plain{begin, tmp._current_pos}};
+    }
+
+    /// Return `mp_reader<mp_plain>` for a value with the specified key.
+    /// Current parsing position stays unchanged. Throws if the key is not found.
+    template <typename T>
+    mp_reader<mp_plain> operator[](const T &key) const
+        requires (std::is_same<MP, mp_map>::value)
+    {
+        return {_mp[key]};
+    }
+
+    template <typename T>
+    mp_reader<mp_plain> find(const T &key) const
+        requires (std::is_same<MP, mp_map>::value)
+    {
+        return {_mp.find(key)};
+    }
+
+    /// Strings with custom allocators (e.g. std::pmr::string) are filled within their own memory resource.
+    template <typename Alloc>
+    mp_reader& operator>> (std::basic_string<char, std::char_traits<char>, Alloc> &val)
+    {
+        if (!_current_pos)
+            throw std::runtime_error("no msgpack data to read");
+
+        if (mp_typeof(*_current_pos) == MP_EXT)
+        {
+            // regular print
+            if (val.size() < 128)
+                val.resize(128, '\0');
+            size_t len = mp_snprint(val.data(), val.size(), _current_pos, UNQUOTE_UUID);
+            if (len > val.size())
+            {
+                val.resize(len + 1, '\0');
+                len = mp_snprint(val.data(), len + 1, _current_pos, UNQUOTE_UUID);
+            }
+            if (len < 0)
+                throw mp_reader_error("bad ext value content", _mp, _current_pos);
+            val.resize(len);
+            skip();
+        }
+        else
+        {
+            std::string_view tmp;
+            *this >> tmp;
+            if (!tmp.data())
+                throw mp_reader_error("string expected, got no data", _mp);
+            val.assign(tmp.data(), tmp.size());
+        }
+        return *this;
+    }
+
+    mp_reader& operator>> (std::string_view &val)
+    {
+        // for the sake of convenience
+        if (!has_next())
+        {
+            val = {};
+            return *this;
+        }
+
+        auto type = mp_typeof(*_current_pos);
+        if (type == MP_STR)
+        {
+            const char *prev = _current_pos;
+            uint32_t len = 0;
+            skip();
+            const char *value = mp_decode_str(&prev, &len);
+            val = {value, len};
+        }
+        else if (type == MP_NIL)
+        {
+            skip();
+            val = {}; // data() == nullptr
+        }
+        else
+        {
+            throw mp_reader_error("string expected, got " + mpuck_type_name(type), _mp, _current_pos);
+        }
+        return *this;
+    }
+
+    mp_reader& operator>> (bool &val)
+    {
+        if (!_current_pos)
+            throw std::runtime_error("no msgpack data to read");
+        const char *data = _current_pos;
+        auto type = mp_typeof(*data);
+        if (type != MP_BOOL)
+            throw mp_reader_error("boolean expected, got " + mpuck_type_name(type), _mp, _current_pos);
+
+        val = mp_decode_bool(&data);
+        skip();
+        return *this;
+    }
+
+    /// Use `>> mp_none()` to skip a value or `>> mp_none<N>()` to skip N items
+    template<size_t N = 1>
+    mp_reader& operator>> (mp_none<N>)
+    {
+        for (int i = 0; i < N; ++i)
+            skip();
+        return *this;
+    }
+
+    template<size_t maxN>
+    mp_reader& operator>> (mp_span<maxN> &dst)
+    {
+        dst.begin = _current_pos;
+        for (size_t i = 0; i < maxN && has_next(); ++i)
+        {
+            skip();
+            dst.rbounds[i] = _current_pos - dst.begin;
+            ++dst.cardinality;
+        }
+        dst.end = _current_pos;
+        return *this;
+    }
+
+    /// Decode Tarantool extension value as is (mp_decimal, mp_uuid, mp_datetime, mp_interval).
+    template <mp_ext_value T>
+    mp_reader& operator>> (T &val)
+    {
+        if (!_current_pos)
+            throw std::runtime_error("no msgpack data to read");
+        auto type = mp_typeof(*_current_pos);
+        if (type != MP_EXT)
+            throw mp_reader_error("ext value expected, got " + mpuck_type_name(type), _mp, _current_pos);
+        const char *head = _current_pos;
+        skip(); // check bounds
+        int8_t ext_type;
+        const char *data = head;
+        uint32_t len = mp_decode_extl(&data, &ext_type);
+        if (ext_type != T::ext_type || !T::decode(data, len, val))
+        {
+            _current_pos = head;
+            --_current_ind;
+            if (ext_type != T::ext_type)
+                throw mp_reader_error("unexpected ext type " + std::to_string(ext_type) +
+                                      " (" + std::to_string(T::ext_type) + " expected)", _mp, head);
+            throw mp_reader_error("invalid ext value", _mp, head);
+        }
+        return *this;
+    }
+
+    template <typename C, typename D>
+    mp_reader& operator>> (std::chrono::time_point<C, D> &val)
+    {
+        if (!_current_pos)
+            throw std::runtime_error("no msgpack data to read");
+        using namespace std::chrono;
+        auto type = mp_typeof(*_current_pos);
+        switch (type) {
+        case MP_UINT:
+        case MP_INT:
+            val = time_point<C, D>(D(read<int64_t>()));
+            break;
+        case MP_FLOAT:
+        case MP_DOUBLE:
+            val = time_point<C, D>(D(read<double>()));
+            break;
+        case MP_EXT:
+        {
+            struct tmp {
+                int32_t nsec;
+                int16_t tzoffset;
+                int16_t tzindex;
+            } tail = {0, 0, 0};
+
+            int8_t ext_type;
+            const char *data = _current_pos;
+            uint32_t len = mp_decode_extl(&data, &ext_type);
+
+            if (ext_type != MP_DATETIME)
+                throw mp_reader_error("unable to extract time_point from " + mpuck_type_name(type), _mp, data);
+            if (len != sizeof(int64_t) && len != sizeof(int64_t) + sizeof(tail))
+                throw mp_reader_error("unexpected MP_DATETIME value", _mp, data);
+
+            int64_t epoch;
+            memcpy(&epoch, data, sizeof(epoch));
+            data += sizeof(epoch);
+
+            if (len != sizeof(int64_t))
+                memcpy(&tail, data, sizeof(tail));
+
+            if (tail.nsec)
+                val = time_point<C, D>(duration<int64_t, std::nano>(tail.nsec + epoch*1000000000));
+            else
+                val = time_point<C, D>(duration<int64_t>(epoch));
+            skip();
+            break;
+        }
+        default:
+            throw mp_reader_error("unable to get time_point from " + mpuck_type_name(type), _mp, _current_pos);
+        }
+
+        return *this;
+    }
+
+    template <typename T>
+    mp_reader& operator>> (std::optional<T> &val)
+    {
+        if (!has_next(true))
+        {
+            val = std::nullopt;
+        }
+        else if (mp_typeof(*_current_pos) == MP_NIL)
+        {
+            skip();
+            val = std::nullopt;
+        }
+        else
+        {
+            T non_opt = mp_make_like(val);
+            *this >> non_opt;
+            val = std::move(non_opt);
+        }
+        return *this;
+    }
+
+    template <typename T>
+    mp_reader& operator>> (mp_optional<T> &&val)
+    {
+        if (!has_next(true))
+        {
+            val.dst = val.def;
+        }
         else if (mp_typeof(*_current_pos) == MP_NIL)
         {
-            skip();
-            val = std::nullopt;
+            skip();
+            val.dst = val.def;
+        }
+        else
+        {
+            *this >> val.dst;
+        }
+        return *this;
+    }
+
+    template <typename T>
+    T read_or(const T &def)
+    {
+        if (!has_next(true))
+            return def;
+
+        if (mp_typeof(*_current_pos) == MP_NIL)
+        {
+            skip();
+            return def;
+        }
+
+        return read<T>();
+    }
+
+    // use external operator overload for 128 bit integers
+    template <typename T, typename = std::enable_if_t<
+                  (std::is_integral_v<T> && sizeof(T) < 16) ||
+                   std::is_floating_point_v<T>
+                   >>
+    mp_reader& operator>> (T &val)
+    {
+        const char *data = _current_pos;
+        const char *prev_pos = _current_pos;
+        skip();
+
+        auto ext_via_string = [prev_pos, &val, this]() -> mp_reader& {
+            char tmp[64];
+            auto len = mp_snprint(tmp, 64, prev_pos, 0);
+            auto [ptr, ec] = std::from_chars(tmp, tmp + len, val);
+            if (ec == std::errc())
+                return *this;
+
+            if (ec == std::errc::invalid_argument)
+                throw mp_reader_error("not a number", _mp, prev_pos);
+            else if (ec == std::errc::result_out_of_range)
+                throw mp_reader_error("out of range", _mp, prev_pos);
+            throw mp_reader_error("error parsing number", _mp, prev_pos);
+        };
+
+        auto type = mp_typeof(*data);
+        if constexpr (std::is_floating_point_v<T>)
+        {
+            if (type == MP_FLOAT)
+            {
+                val = mp_decode_float(&data);
+                return *this;
+            }
+            else if (type == MP_DOUBLE)
+            {
+                double res = mp_decode_double(&data);
+                if constexpr (std::is_same_v<T, float>)
+                {
+                    if (std::isfinite(res) && (res > std::numeric_limits<T>::max() || res < std::numeric_limits<T>::lowest()))
+                        throw mp_reader_error("value overflow", _mp);
+                }
+                val = static_cast<T>(res);
+                return *this;
+            }
+            else if (type == MP_EXT)
+            {
+                return ext_via_string();
+            }
+            throw mp_reader_error("float expected, got " + mpuck_type_name(type), _mp, prev_pos);
+        }
+        else
+        {
+            if (type == MP_UINT)
+            {
+                uint64_t res = mp_decode_uint(&data);
+                if (res <= std::numeric_limits<T>::max())
+                {
+                    val = static_cast<T>(res);
+                    return *this;
+                }
+            }
+            else if (type == MP_INT)
+            {
+                int64_t res = mp_decode_int(&data);
+                // negative numbers never fit unsigned types (even uint64_t), the others may
+                if (std::in_range<T>(res))
+                {
+                    val = static_cast<T>(res);
+                    return *this;
+                }
+            }
+            else if (type == MP_EXT)
+            {
+                return ext_via_string();
+            }
+            else
+            {
+                throw mp_reader_error("integer expected, got " + mpuck_type_name(type), _mp, prev_pos);
+            }
+            throw mp_reader_error("value overflow", _mp);
+        }
+    }
+
+    /// Numeric arrays are decoded in bulk (see read_numeric()).
+    template <typename T, typename Alloc>
+    mp_reader& operator>> (std::vector<T, Alloc> &val)
+    {
+        auto arr = read<mp_reader<mp_array>>();
+        val.resize(arr.cardinality());
+        if constexpr (mp_bulk_numeric_v<T>)
+        {
+            arr.read_numeric(val.data(), val.size());
+        }
+        else
+        {
+            for (size_t i = 0; i < val.size(); ++i)
+                arr >> val[i];
+        }
+        return *this;
+    }
+
+    /** Decode `n` numeric items into `dst`. Runs of items with the same encoding
+     *  are converted within tight (auto-vectorizable) loops with a single range
+     *  check per run, other items (ext, mismatched types) go through operator>>,
+     *  so the result and errors are the same as with per item decoding. */
+    template <typename T>
+        requires mp_bulk_numeric_v<T>
+    mp_reader& read_numeric(T *dst, size_t n)
+    {
+        size_t i = 0;
+        while (i < n)
+        {
+            const char *p = _current_pos;
+            size_t avail = _mp.end ? static_cast<size_t>(_mp.end - p) : SIZE_MAX;
+            size_t max_run = std::min(n - i, avail);
+            if (!p || !max_run)
+            {
+                *this >> dst[i++]; // throws
+                continue;
+            }
+
+            auto c = static_cast<uint8_t>(*p);
+            size_t run = 0;
+            size_t stride = 1;
+            bool ok = true;
+            auto count_run = [p, c, left = n - i, avail](size_t stride) {
+                size_t max = std::min(left, avail / stride);
+                size_t r = 0;
+                while (r < max && static_cast<uint8_t>(p[r * stride]) == c)
+                    ++r;
+                return r;
+            };
+
+            if constexpr (std::is_floating_point_v<T>)
+            {
+                if (c == 0xca)
+                {
+                    stride = 5;
+                    run = count_run(stride);
+                    ok = convert_run<float>(p + 1, stride, dst + i, run);
+                }
+                else if (c == 0xcb)
+                {
+                    stride = 9;
+                    run = count_run(stride);
+                    ok = convert_run<double>(p + 1, stride, dst + i, run);
+                }
+            }
+            else
+            {
+                if (c <= 0x7f) // positive fixint, fits any T
+                {
+                    while (run < max_run && static_cast<uint8_t>(p[run]) <= 0x7f)
+                    {
+                        dst[i + run] = static_cast<T>(p[run]);
+                        ++run;
+                    }
+                }
+                else if (c >= 0xe0 && std::is_signed_v<T>) // negative fixint
+                {
+                    while (run < max_run && static_cast<uint8_t>(p[run]) >= 0xe0)
+                    {
+                        dst[i + run] = static_cast<T>(static_cast<int8_t>(p[run]));
+                        ++run;
+                    }
+                }
+                else
+                {
+                    switch (c)
+                    {
+                    case 0xcc: stride = 2; run = count_run(stride); ok = convert_run<uint8_t>(p + 1, stride, dst + i, run); break;
+                    case 0xcd: stride = 3; run = count_run(stride); ok = convert_run<uint16_t>(p + 1, stride, dst + i, run); break;
+                    case 0xce: stride = 5; run = count_run(stride); ok = convert_run<uint32_t>(p + 1, stride, dst + i, run); break;
+                    case 0xcf: stride = 9; run = count_run(stride); ok = convert_run<uint64_t>(p + 1, stride, dst + i, run); break;
+                    case 0xd0: stride = 2; run = count_run(stride); ok = convert_run<int8_t>(p + 1, stride, dst + i, run); break;
+                    case 0xd1: stride = 3; run = count_run(stride); ok = convert_run<int16_t>(p + 1, stride, dst + i, run); break;
+                    case 0xd2: stride = 5; run = count_run(stride); ok = convert_run<int32_t>(p + 1, stride, dst + i, run); break;
+                    case 0xd3: stride = 9; run = count_run(stride); ok = convert_run<int64_t>(p + 1, stride, dst + i, run); break;
+                    }
+                }
+            }
+
+            if (!run)
+            {
+                *this >> dst[i++];
+            }
+            else if (!ok)
+            {
+                // report the overflow exactly as per item decoding does
+                for (size_t k = 0; k < run; ++k)
+                    *this >> dst[i++];
+            }
+            else
+            {
+                _current_pos = p + run * stride;
+                _current_ind += run;
+                i += run;
+            }
+        }
+        return *this;
+    }
+
+    /// Keys and values are decoded within the map's allocator (if they are allocator-aware).
+    template <typename KeyT, typename ValueT, typename Compare, typename Alloc>
+    mp_reader& operator>> (std::map<KeyT, ValueT, Compare, Alloc> &val)
+    {
+        auto map = read<mp_reader<mp_map>>();
+        auto alloc = val.get_allocator();
+        for (size_t i = 0; i < map.cardinality(); ++i)
+        {
+            auto k = std::make_obj_using_allocator<KeyT>(alloc);
+            auto v = std::make_obj_using_allocator<ValueT>(alloc);
+            map >> k >> v;
+            val.insert_or_assign(std::move(k), std::move(v));
+        }
+        return *this;
+    }
+
+    template <typename... Args>
+    mp_reader& operator>> (std::tuple<Args...> &val)
+    {
+        auto arr = read<mp_reader<mp_array>>();
+        std::apply(
+            [&arr](auto&... item)
+            {
+                ((arr >> item), ...);
+            },
+            val
+            );
+        return *this;
+    }
+
+    mp_reader& operator>> (mp_string_view &val)
+    {
+        return *this >> static_cast<std::string_view&>(val);
+    }
+
+    template <typename... Ts>
+    mp_reader& operator>> (mp_tuple_view<Ts...> &val)
+    {
+        const char *begin = _current_pos;
+        *this >> val._values;
+        val._raw = {begin, _current_pos};
+        return *this;
+    }
+
+    template <typename... Args>
+    mp_reader& operator>> (std::tuple<Args&...> val)
+    {
+        auto arr = read<mp_reader<mp_array>>();
+        std::apply(
+            [&arr](auto&... item)
+            {
+                ((arr >> item), ...);
+            },
+            val
+            );
+        return *this;
+    }
+
+    mp_reader& operator>> (mp_reader<mp_plain> &val)  = delete;
+
+    mp_reader& operator>> (mp_reader<mp_array> &val)
+    {
+        val._mp = mp_array(_current_pos);
+        val._current_pos = val._mp.begin;
+        val._current_ind = 0;
+        skip();
+        if (!val._mp.end)
+            val._mp.end = _current_pos;
+        return *this;
+    }
+
+    mp_reader& operator>> (mp_reader<mp_map> &val)
+    {
+        val._mp = mp_map(_current_pos);
+        val._current_pos = val._mp.begin;
+        val._current_ind = 0;
+        skip();
+        val._mp.end = _current_pos;
+        return *this;
+    }
+
+    template <typename T>
+    T read()
+    {
+        T res;
+        *this >> res;
+        return res;
+    }
+
+    template <size_t maxN>
+    const mp_span<maxN> read()
+    {
+        mp_span<maxN> dst{};
+        *this >> dst;
+        return dst;
+    }
+
+    template <typename... Args>
+    mp_reader& values(Args&... args)
+    {
+        ((*this) >> ... >> args);
+        return *this;
+    }
+
+    /** Exception-free extraction. Returns error status instead of throwing
+     *  and leaves current position and `val` unchanged on failure (so another type may be tried).
+     *  Supports arithmetic types, bool, string_view, string, optional, mp_none
+     *  and nested array/map readers. */
+    template <typename T>
+    mp_read_status try_read(T &val) noexcept
+    {
+        const char *next = nullptr;
+        mp_read_status res = try_next(next);
+        if (!res)
+            return res;
+
+        const char *data = _current_pos;
+        auto type = mp_typeof(*data);
+        auto mismatch = [&res, type](mp_type expected) {
+            res.code = mp_errc::type_mismatch;
+            res.expected = expected;
+            res.actual = type;
+            return res;
+        };
+
+        if constexpr (std::is_same_v<T, bool>)
+        {
+            if (type != MP_BOOL)
+                return mismatch(MP_BOOL);
+            val = mp_decode_bool(&data);
+        }
+        else if constexpr (std::is_floating_point_v<T>)
+        {
+            if (type == MP_FLOAT)
+            {
+                val = mp_decode_float(&data);
+            }
+            else if (type == MP_DOUBLE)
+            {
+                double tmp = mp_decode_double(&data);
+                if constexpr (std::is_same_v<T, float>)
+                {
+                    if (std::isfinite(tmp) && std::fabs(tmp) > std::numeric_limits<T>::max())
+                    {
+                        res.code = mp_errc::overflow;
+                        return res;
+                    }
+                }
+                val = static_cast<T>(tmp);
+            }
+            else if (type == MP_EXT)
+            {
+                T tmp;
+                if (!try_ext_number(tmp))
+                {
+                    res.code = mp_errc::unsupported;
+                    res.actual = type;
+                    return res;
+                }
+                val = tmp;
+            }
+            else
+            {
+                return mismatch(MP_DOUBLE);
+            }
+        }
+        else if constexpr (std::is_integral_v<T> && sizeof(T) < 16)
+        {
+            // decoded aside, `val` is assigned on success only
+            T out{};
+            bool fits = false;
+            if (type == MP_UINT)
+            {
+                uint64_t tmp = mp_decode_uint(&data);
+                fits = std::in_range<T>(tmp);
+                out = static_cast<T>(tmp);
+            }
+            else if (type == MP_INT)
+            {
+                int64_t tmp = mp_decode_int(&data);
+                fits = std::in_range<T>(tmp);
+                out = static_cast<T>(tmp);
+            }
+            else if (type == MP_EXT)
+            {
+                if (!try_ext_number(out))
+                {
+                    res.code = mp_errc::unsupported;
+                    res.actual = type;
+                    return res;
+                }
+                fits = true;
+            }
+            else
+            {
+                return mismatch(MP_UINT);
+            }
+            if (!fits)
+            {
+                res.code = mp_errc::overflow;
+                return res;
+            }
+            val = out;
+        }
+        else if constexpr (std::is_same_v<T, std::string_view> || std::is_same_v<T, std::string>)
+        {
+            if (type == MP_STR)
+            {
+                uint32_t len = 0;
+                const char *str = mp_decode_str(&data, &len);
+                if constexpr (std::is_same_v<T, std::string>)
+                {
+                    // assign() keeps the string intact if it throws
+                    try
+                    {
+                        val.assign(str, len);
+                    }
+                    catch (...)
+                    {
+                        res.code = mp_errc::no_memory;
+                        return res;
+                    }
+                }
+                else
+                {
+                    val = {str, len};
+                }
+            }
+            else if (type == MP_NIL)
+            {
+                val = {};
+            }
+            else if (type == MP_EXT)
+            {
+                res.code = mp_errc::unsupported;
+                res.actual = type;
+                return res;
+            }
+            else
+            {
+                return mismatch(MP_STR);
+            }
+        }
+        else if constexpr (std::is_same_v<T, mp_reader<mp_array>> || std::is_same_v<T, mp_reader<mp_map>>)
+        {
+            constexpr mp_type container_type = std::is_same_v<T, mp_reader<mp_array>> ? MP_ARRAY : MP_MAP;
+            if (type != container_type)
+                return mismatch(container_type);
+            size_t cardinality = container_type == MP_ARRAY ? mp_decode_array(&data) : mp_decode_map(&data);
+            val._mp = {data, next, cardinality};
+            val._current_pos = data;
+            val._current_ind = 0;
+        }
+        else
+        {
+            static_assert(!sizeof(T), "unsupported type for try_read()");
+        }
+
+        _current_pos = next;
+        ++_current_ind;
+        return res;
+    }
+
+    template <typename T>
+    mp_read_status try_read(std::optional<T> &val) noexcept
+    {
+        const char *next = nullptr;
+        if (!has_next())
+        {
+            val = std::nullopt;
+            return {mp_errc::ok, MP_NIL, MP_NIL, _mp, _current_pos};
+        }
+        mp_read_status res = try_next(next);
+        if (!res)
+            return res;
+        if (mp_typeof(*_current_pos) == MP_NIL)
+        {
+            val = std::nullopt;
+            _current_pos = next;
+            ++_current_ind;
+            return res;
+        }
+        T non_opt;
+        res = try_read(non_opt);
+        if (res)
+            val = std::move(non_opt);
+        return res;
+    }
+
+    template<size_t N = 1>
+    mp_read_status try_read(mp_none<N>) noexcept
+    {
+        auto prev_pos = _current_pos;
+        auto prev_ind = _current_ind;
+        for (size_t i = 0; i < N; ++i)
+        {
+            const char *next = nullptr;
+            mp_read_status res = try_next(next);
+            if (!res)
+            {
+                _current_pos = prev_pos;
+                _current_ind = prev_ind;
+                return res;
+            }
+            _current_pos = next;
+            ++_current_ind;
+        }
+        return {mp_errc::ok, MP_NIL, MP_NIL, _mp, _current_pos};
+    }
+
+    /// Exception-free extraction. See try_read(T &val).
+    template <typename T>
+    mp_expected<T> try_read() noexcept(std::is_nothrow_default_constructible_v<T>)
+    {
+        mp_expected<T> res;
+        res.status = try_read(res.value);
+        return res;
+    }
+
+    /** Extract specified fields only within a single forward pass, e.g.
+     *  `tuple.project(mp_at(2, name), mp_at(17, price))` or
+     *  `map.project(mp_at("id", id), mp_at("tags", tags))`.
+     *
+     *  Array reader: keys are absolute indexes (any order), the items between are skipped in bulk,
+     *  missing tail items are allowed for std::optional destinations only.
+     *  Map reader: every pair from the current position is examined until all keys are found,
+     *  missing keys reset std::optional destinations and throw otherwise.
+     *  Current position is moved right after the last extracted value. */
+    template <typename... K, typename... T>
+    mp_reader& project(const mp_at<K, T>&... fields)
+    {
+        constexpr size_t n = sizeof...(fields);
+        if constexpr (std::is_same<MP, mp_map>::value)
+        {
+            std::array<bool, n> found{};
+            size_t found_cnt = 0;
+            while (found_cnt < n && has_next())
+            {
+                // the first unmatched field with the current key
+                size_t target = n;
+                size_t i = 0;
+                ((target == n && !found[i] && equals(fields.key) ? void(target = i) : void(), ++i), ...);
+                skip(); // key
+                if (target == n)
+                {
+                    skip();
+                    continue;
+                }
+                found[target] = true;
+                ++found_cnt;
+                i = 0;
+                ((i++ == target ? void(*this >> fields.dst) : void()), ...);
+            }
+
+            size_t i = 0;
+            (([&] {
+                if (!found[i++])
+                {
+                    if constexpr (is_std_optional_v<std::remove_cvref_t<decltype(fields.dst)>>)
+                        fields.dst = std::nullopt;
+                    else
+                        throw mp_reader_error("key not found", _mp);
+                }
+            }()), ...);
+        }
+        else
+        {
+            std::array<size_t, n> indexes{static_cast<size_t>(fields.key)...};
+            std::array<size_t, n> order;
+            for (size_t i = 0; i < n; ++i)
+                order[i] = i;
+            std::sort(order.begin(), order.end(), [&indexes](size_t a, size_t b) { return indexes[a] < indexes[b]; });
+
+            if (n && indexes[order[0]] < _current_ind)
+                rewind();
+
+            for (size_t o: order)
+            {
+                size_t target = indexes[o];
+                if (target < _current_ind)
+                    throw mp_reader_error("duplicate projection index " + std::to_string(target), _mp);
+                if (has_next())
+                {
+                    size_t avail = target - _current_ind;
+                    if constexpr (requires {_mp.cardinality;})
+                        avail = std::min(avail, _mp.cardinality - _current_ind);
+                    skip(avail);
+                }
+                size_t i = 0;
+                ((i++ == o ? void(*this >> fields.dst) : void()), ...);
+            }
+        }
+        return *this;
+    }
+
+    /** Map projection with learned layout (see mp_map_shape), e.g.
+     *  `static thread_local mp_map_shape shape("id", "tags"); map.project(shape, id, tags);`
+     *  `dst` receive values of the shape's fields in the order the fields were specified.
+     *  Missing keys reset std::optional destinations and throw otherwise.
+     *  Current position is moved right after the last examined pair. */
+    template <typename... T>
+    mp_reader& project(mp_map_shape &shape, T&... dst)
+        requires (std::is_same<MP, mp_map>::value)
+    {
+        constexpr size_t n = sizeof...(dst);
+        if (shape.size() != n)
+            throw mp_reader_error("projection shape has " + std::to_string(shape.size()) +
+                                  " fields, " + std::to_string(n) + " destinations passed", _mp);
+        std::array<mp_plain, n> values;
+        const char *pos = _current_pos;
+        size_t pairs = has_next() ? (_mp.cardinality * 2 - _current_ind) / 2 : 0;
+        pairs = shape.locate(pos, _mp.end, pairs, values);
+
+        size_t i = 0;
+        (([&] {
+            const mp_plain &value = values[i++];
+            if (value.begin)
+                mp_reader<mp_plain>(value) >> dst;
+            else if constexpr (is_std_optional_v<std::remove_cvref_t<decltype(dst)>>)
+                dst = std::nullopt;
+            else
+                throw mp_reader_error("key not found", _mp);
+        }()), ...);
+
+        _current_pos = pos;
+        _current_ind += pairs * 2;
+        return *this;
+    }
+
+    /** Runtime projection: call `fn(size_t field_no, mp_reader &r)` with this reader
+     *  positioned at every requested field (`field_no` is the position within `keys`).
+     *  Array reader: `keys` are ascending absolute indexes (missing tail items are not reported).
+     *  Map reader: `keys` are map keys, absent keys are not reported.
+     *  The callback may read the value or leave it to be skipped. Returns the number of fields found. */
+    template <typename K, typename F>
+    size_t project(std::span<const K> keys, F &&fn)
+    {
+        size_t found_cnt = 0;
+        auto call = [this, &fn](size_t field_no) {
+            auto ind = _current_ind;
+            fn(field_no, *this);
+            if (_current_ind == ind)
+                skip();
+        };
+
+        if constexpr (std::is_same<MP, mp_map>::value)
+        {
+            while (found_cnt < keys.size() && has_next())
+            {
+                size_t i = 0;
+                for (; i < keys.size(); ++i)
+                {
+                    if (equals(keys[i]))
+                        break;
+                }
+                skip(); // key
+                if (i == keys.size())
+                {
+                    skip();
+                    continue;
+                }
+                ++found_cnt;
+                call(i);
+            }
         }
         else
         {
-            T non_opt;
-            *this >> non_opt;
-            val = std::move(non_opt);
+            for (size_t i = 0; i < keys.size(); ++i)
+            {
+                size_t target = static_cast<size_t>(keys[i]);
+                if (target < _current_ind)
+                {
+                    if (i)
+                        throw mp_reader_error("projection indexes must be ascending", _mp);
+                    rewind();
+                }
+                if (!has_next())
+                    break;
+                if constexpr (requires {_mp.cardinality;})
+                {
+                    if (target >= _mp.cardinality)
+                        break;
+                }
+                skip(target - _current_ind);
+                if (!has_next())
+                    break;
+                ++found_cnt;
+                call(i);
+            }
+        }
+        return found_cnt;
+    }
+
+    template <typename T>
+    bool equals(const T &val) const
+    {
+        if (!has_next())
+            throw mp_reader_error("read out of bounds", _mp);
+        auto begin = _current_pos;
+        //auto end = begin;
+        //mp_next(&end);
+        //mp_reader tmp(begin, end);
+        mp_reader<mp_plain> tmp(mp_plain{_current_pos});
+
+        auto type = mp_typeof(*_current_pos);
+        if constexpr (std::is_same_v<T, mp_key>)
+        {
+            auto end = begin;
+            mp_next(&end);
+            return val.matches(begin, end);
+        }
+        else if constexpr (std::is_same_v<T, bool>)
+        {
+            return type == MP_BOOL && val == tmp.read<T>();
+        }
+        else if constexpr (std::is_enum_v<T> || (std::is_integral_v<T> && sizeof(T) < 16))
+        {
+            if (type == MP_UINT && val >= 0)
+            {
+                uint64_t res = mp_decode_uint(&begin);
+                return res == static_cast<uint64_t>(val);
+            }
+            else if (type == MP_INT)
+            {
+                int64_t res = mp_decode_int(&begin);
+                if (res < 0 && val < 0)
+                    return res == val;
+                if (res >= 0 && val >= 0)
+                    return static_cast<uint64_t>(res) == static_cast<uint64_t>(val);
+            }
+        }
+        else if constexpr (std::is_floating_point_v<T>)
+        {
+            //if (isnan(val))
+            //    return type == MP_NIL;
+            if (type == MP_FLOAT)
+                return val == mp_decode_float(&begin);
+            if (type == MP_DOUBLE)
+                return val == mp_decode_double(&begin);
+        }
+        else if constexpr (std::is_same_v<T, std::string_view>)
+        {
+            if (val.data() == nullptr)
+                return type == MP_NIL;
+            else if (type == MP_STR)
+                return val == tmp.read<std::string_view>();
+        }
+        else if constexpr (std::is_same_v<T, std::string>)
+        {
+            if (type == MP_STR)
+                return val == tmp.read<std::string_view>();
+        }
+        else if constexpr (std::is_same_v<typename std::decay_t<T>, char *>)
+        {
+            if (val == nullptr)
+                return type == MP_NIL;
+            else if (type == MP_STR)
+                return val == tmp.read<std::string_view>();
+        }
+        else
+        {
+            throw mp_reader_error("unsupported value type to compare with", _mp);
+        }
+
+        return false;
+    }
+
+private:
+    /// Convert `n` big-endian values of type U placed `stride` bytes apart.
+    /// Returns false if any value does not fit T.
+    template <typename U, typename T>
+    static bool convert_run(const char *src, size_t stride, T *dst, size_t n) noexcept
+    {
+        bool ok = true;
+        for (size_t k = 0; k < n; ++k)
+        {
+            const char *p = src + k * stride;
+            U v;
+            if constexpr (sizeof(U) == 1)
+                v = static_cast<U>(mp_load_u8(&p));
+            else if constexpr (sizeof(U) == 2)
+                v = static_cast<U>(mp_load_u16(&p));
+            else if constexpr (sizeof(U) == 4)
+                v = std::bit_cast<U>(mp_load_u32(&p));
+            else
+                v = std::bit_cast<U>(mp_load_u64(&p));
+
+            if constexpr (std::is_floating_point_v<T>)
+            {
+                if constexpr (sizeof(T) < sizeof(U))
+                    ok &= !std::isfinite(v) || (v <= std::numeric_limits<T>::max() && v >= std::numeric_limits<T>::lowest());
+            }
+            else
+            {
+                ok &= std::in_range<T>(v);
+            }
+            dst[k] = static_cast<T>(v);
+        }
+        return ok;
+    }
+
+    /// Validate next item (if right bound is known) and acquire its end without throwing.
+    mp_read_status try_next(const char *&next) const noexcept
+    {
+        mp_read_status res{mp_errc::ok, MP_NIL, MP_NIL, _mp, _current_pos};
+        if (!_current_pos)
+        {
+            res.code = mp_errc::no_data;
+        }
+        else if (!has_next())
+        {
+            res.code = mp_errc::out_of_bounds;
+        }
+        else
+        {
+            next = _current_pos;
+            if (!_mp.end)
+                mp_next(&next);
+            else if (mp_check(&next, _mp.end))
+                res.code = mp_errc::invalid;
+        }
+        return res;
+    }
+
+    /// Convert numeric ext value (decimal) via its text representation (no allocation).
+    template <typename T>
+    bool try_ext_number(T &val) const noexcept
+    {
+        char tmp[64];
+        int len = mp_snprint(tmp, sizeof(tmp), _current_pos, 0);
+        if (len <= 0 || len >= static_cast<int>(sizeof(tmp)))
+            return false;
+        auto [ptr, ec] = std::from_chars(tmp, tmp + len, val);
+        return ec == std::errc() && ptr == tmp + len;
+    }
+};
+
+template <size_t maxN>
+mp_span<maxN>::mp_span(const char *begin, const char *end) : mp_array(begin, end, 0)
+{
+    auto r = mp_reader{mp_plain{begin, end}};
+    r >> *this;
+}
+
+template <typename T>
+mp_plain mp_map::find(const T &key) const
+{
+    auto tmp = mp_reader{mp_plain(begin, end)};
+    auto n = cardinality;
+    while (n-- > 0)
+    {
+        bool found = tmp.equals(key);
+        tmp.skip(); // skip a key
+
+        auto value_begin = tmp.pos();
+        tmp.skip();
+        auto value_end = tmp.pos();
+
+        if (found)
+            return {value_begin, value_end};
+    }
+    return {nullptr, nullptr};
+}
+
+/** messagepack reader without bounds and type checks.
+ *
+ * Extraction operators are plain msgpuck decodes (types are verified by asserts
+ * in debug builds only), so the whole content must be validated once in advance
+ * (see mp_reader::check() and tnt::connection::set_input_validation()).
+ */
+template<typename MP = mp_plain>
+class mp_unchecked_reader
+{
+    template<typename T>
+    friend class mp_unchecked_reader;
+
+    static_assert(std::derived_from<MP, mp_plain>, "mp_unchecked_reader operates on mp_plain and its descendants");
+protected:
+    MP _mp;
+    const char *_current_pos = nullptr;
+    uint32_t _current_ind = 0;
+
+public:
+    mp_unchecked_reader() = default;
+    mp_unchecked_reader(MP mp) : _mp(mp), _current_pos(_mp.begin) {}
+    mp_unchecked_reader(const wtf_buffer &buf) : mp_unchecked_reader(MP{buf.data(), buf.end}) {}
+    mp_unchecked_reader(const std::vector<char> &buf) : mp_unchecked_reader(MP{buf.data(), buf.data() + buf.size()}) {}
+    mp_unchecked_reader(const char *begin, const char *end) : mp_unchecked_reader(MP{begin, end}) {}
+
+    MP content() const noexcept
+    {
+        return _mp;
+    }
+
+    const char* begin() const noexcept
+    {
+        return _mp.begin;
+    }
+
+    const char* end() const noexcept
+    {
+        return _mp.end;
+    }
+
+    const char* pos() const noexcept
+    {
+        return _current_pos;
+    }
+
+    uint32_t ind() const noexcept
+    {
+        return _current_ind;
+    }
+
+    /// Cardinality of the array or map.
+    size_t cardinality() const noexcept
+        requires (std::is_same<MP, mp_array>::value || std::is_same<MP, mp_map>::value)
+    {
+        return _mp.cardinality;
+    }
+
+    /// true if not empty
+    operator bool() const noexcept
+    {
+        return _mp;
+    }
+
+    /// Returns `true` if msgpack has more values to read.
+    bool has_next() const noexcept
+    {
+        if constexpr (std::is_same<MP, mp_map>::value)
+            return _current_ind < _mp.cardinality * 2;
+        else if constexpr (std::is_same<MP, mp_array>::value)
+            return _current_ind < _mp.cardinality;
+        else
+            return _current_pos < _mp.end;
+    }
+
+    /// Return true if the current value is `nil`.
+    bool is_null() const noexcept
+    {
+        return mp_typeof(*_current_pos) == MP_NIL;
+    }
+
+    /// Reset the current reading position back to the beginning.
+    void rewind() noexcept
+    {
+        _current_pos = _mp.begin;
+        _current_ind = 0;
+    }
+
+    /// Skip `n` encoded items (in case of array/map skips all its elements).
+    mp_unchecked_reader& skip(size_t n = 1) noexcept
+    {
+        for (size_t i = 0; i < n; ++i)
+            mp_next(&_current_pos);
+        _current_ind += static_cast<uint32_t>(n);
+        return *this;
+    }
+
+    /// Return current encoded iproto message (header + body) within separate reader
+    /// and move current position to next item.
+    mp_unchecked_reader<mp_plain> iproto_message() noexcept
+    {
+        if (_mp.end - _current_pos < 5)
+            return {mp_plain{_current_pos, _current_pos}}; // empty object
+
+        assert(static_cast<uint8_t>(*_current_pos) == 0xce);
+        uint64_t response_size = mp_decode_uint(&_current_pos);
+        auto head = _current_pos;
+        _current_pos += response_size;
+        return {mp_plain{head, _current_pos}};
+    }
+
+    /// Return reader for a value with the specified key (empty reader if not found).
+    /// Current parsing position stays unchanged.
+    template <typename T>
+    mp_unchecked_reader<mp_plain> find(const T &key) const noexcept
+        requires (std::is_same<MP, mp_map>::value)
+    {
+        const char *pos = _mp.begin;
+        for (size_t i = 0; i < _mp.cardinality; ++i)
+        {
+            bool found = false;
+            auto type = mp_typeof(*pos);
+            if constexpr (std::is_same_v<T, mp_key>)
+            {
+                const char *tmp = pos;
+                mp_next(&tmp);
+                found = key.matches(pos, tmp);
+            }
+            else if constexpr (std::is_integral_v<T> || std::is_enum_v<T>)
+            {
+                if (type == MP_UINT)
+                {
+                    const char *tmp = pos;
+                    found = key >= 0 && mp_decode_uint(&tmp) == static_cast<uint64_t>(key);
+                }
+                else if (type == MP_INT)
+                {
+                    const char *tmp = pos;
+                    found = mp_decode_int(&tmp) == static_cast<int64_t>(key);
+                }
+            }
+            else
+            {
+                if (type == MP_STR)
+                {
+                    const char *tmp = pos;
+                    uint32_t len;
+                    const char *str = mp_decode_str(&tmp, &len);
+                    found = std::string_view{str, len} == key;
+                }
+            }
+            mp_next(&pos);
+            const char *value = pos;
+            mp_next(&pos);
+            if (found)
+                return {mp_plain{value, pos}};
         }
-        return *this;
+        return {mp_plain{}};
     }
 
-    template <typename T>
-    mp_reader& operator>> (mp_optional<T> &&val)
+    mp_unchecked_reader& operator>> (std::string_view &val) noexcept
     {
-        if (!has_next(true))
-        {
-            val.dst = val.def;
-        }
-        else if (mp_typeof(*_current_pos) == MP_NIL)
+        if (mp_typeof(*_current_pos) == MP_NIL)
         {
-            skip();
-            val.dst = val.def;
+            ++_current_pos;
+            val = {};
         }
         else
         {
-            *this >> val.dst;
+            assert(mp_typeof(*_current_pos) == MP_STR);
+            uint32_t len;
+            const char *str = mp_decode_str(&_current_pos, &len);
+            val = {str, len};
         }
+        ++_current_ind;
         return *this;
     }
 
-    template <typename T>
-    T read_or(const T &def)
+    template <typename Alloc>
+    mp_unchecked_reader& operator>> (std::basic_string<char, std::char_traits<char>, Alloc> &val)
     {
-        if (!has_next(true))
-            return def;
-
-        if (mp_typeof(*_current_pos) == MP_NIL)
-        {
-            skip();
-            return def;
-        }
+        std::string_view tmp;
+        *this >> tmp;
+        val.assign(tmp.data(), tmp.size());
+        return *this;
+    }
 
-        return read<T>();
+    mp_unchecked_reader& operator>> (bool &val) noexcept
+    {
+        assert(mp_typeof(*_current_pos) == MP_BOOL);
+        val = mp_decode_bool(&_current_pos);
+        ++_current_ind;
+        return *this;
     }
 
-    // use external operator overload for 128 bit integers
     template <typename T, typename = std::enable_if_t<
                   (std::is_integral_v<T> && sizeof(T) < 16) ||
                    std::is_floating_point_v<T>
                    >>
-    mp_reader& operator>> (T &val)
+    mp_unchecked_reader& operator>> (T &val) noexcept
     {
-        const char *data = _current_pos;
-        const char *prev_pos = _current_pos;
-        skip();
-
-        auto ext_via_string = [prev_pos, &val, this]() -> mp_reader& {
-            char tmp[64];
-            auto len = mp_snprint(tmp, 64, prev_pos, 0);
-            auto [ptr, ec] = std::from_chars(tmp, tmp + len, val);
-            if (ec == std::errc())
-                return *this;
-
-            if (ec == std::errc::invalid_argument)
-                throw mp_reader_error("not a number", _mp, prev_pos);
-            else if (ec == std::errc::result_out_of_range)
-                throw mp_reader_error("out of range", _mp, prev_pos);
-            throw mp_reader_error("error parsing number", _mp, prev_pos);
-        };
-
-        auto type = mp_typeof(*data);
+        auto type = mp_typeof(*_current_pos);
         if constexpr (std::is_floating_point_v<T>)
         {
+            assert(type == MP_FLOAT || type == MP_DOUBLE);
             if (type == MP_FLOAT)
-            {
-                val = mp_decode_float(&data);
-                return *this;
-            }
-            else if (type == MP_DOUBLE)
-            {
-                double res = mp_decode_double(&data);
-                if constexpr (std::is_same_v<T, float>)
-                {
-                    if (std::isfinite(res) && (res > std::numeric_limits<T>::max() || res < std::numeric_limits<T>::min()))
-                        throw mp_reader_error("value overflow", _mp);
-                }
-                val = static_cast<T>(res);
-                return *this;
-            }
-            else if (type == MP_EXT)
-            {
-                return ext_via_string();
-            }
-            throw mp_reader_error("float expected, got " + mpuck_type_name(type), _mp, prev_pos);
+                val = mp_decode_float(&_current_pos);
+            else
+                val = static_cast<T>(mp_decode_double(&_current_pos));
         }
         else
         {
+            assert(type == MP_UINT || type == MP_INT);
             if (type == MP_UINT)
-            {
-                uint64_t res = mp_decode_uint(&data);
-                if (res <= std::numeric_limits<T>::max())
-                {
-                    val = static_cast<T>(res);
-                    return *this;
-                }
-            }
-            else if (type == MP_INT)
-            {
-                int64_t res = mp_decode_int(&data);
-                if (res <= std::numeric_limits<T>::max() && res >= std::numeric_limits<T>::min())
-                {
-                    val = static_cast<T>(res);
-                    return *this;
-                }
-            }
-            else if (type == MP_EXT)
-            {
-                return ext_via_string();
-            }
+                val = static_cast<T>(mp_decode_uint(&_current_pos));
             else
-            {
-                throw mp_reader_error("integer expected, got " + mpuck_type_name(type), _mp, prev_pos);
-            }
-            throw mp_reader_error("value overflow", _mp);
+                val = static_cast<T>(mp_decode_int(&_current_pos));
         }
+        ++_current_ind;
+        return *this;
+    }
+
+    template <mp_ext_value T>
+    mp_unchecked_reader& operator>> (T &val) noexcept
+    {
+        assert(mp_typeof(*_current_pos) == MP_EXT);
+        int8_t ext_type;
+        uint32_t len = mp_decode_extl(&_current_pos, &ext_type);
+        [[maybe_unused]] bool ok = ext_type == T::ext_type && T::decode(_current_pos, len, val);
+        assert(ok);
+        _current_pos += len;
+        ++_current_ind;
+        return *this;
+    }
+
+    /// Use `>> mp_none()` to skip a value or `>> mp_none<N>()` to skip N items
+    template<size_t N = 1>
+    mp_unchecked_reader& operator>> (mp_none<N>) noexcept
+    {
+        return skip(N);
     }
 
     template <typename T>
-    mp_reader& operator>> (std::vector<T> &val)
+    mp_unchecked_reader& operator>> (std::optional<T> &val)
     {
-        auto arr = read<mp_reader<mp_array>>();
+        if (!has_next() || is_null())
+        {
+            if (has_next())
+                skip();
+            val = std::nullopt;
+        }
+        else
+        {
+            T non_opt = mp_make_like(val);
+            *this >> non_opt;
+            val = std::move(non_opt);
+        }
+        return *this;
+    }
+
+    template <typename T, typename Alloc>
+    mp_unchecked_reader& operator>> (std::vector<T, Alloc> &val)
+    {
+        auto arr = read<mp_unchecked_reader<mp_array>>();
         val.resize(arr.cardinality());
         for (size_t i = 0; i < val.size(); ++i)
             arr >> val[i];
         return *this;
     }
 
-    template <typename KeyT, typename ValueT>
-    mp_reader& operator>> (std::map<KeyT, ValueT> &val)
+    /// Keys and values are decoded within the map's allocator (if they are allocator-aware).
+    template <typename KeyT, typename ValueT, typename Compare, typename Alloc>
+    mp_unchecked_reader& operator>> (std::map<KeyT, ValueT, Compare, Alloc> &val)
     {
-        auto map = read<mp_reader<mp_map>>();
+        auto map = read<mp_unchecked_reader<mp_map>>();
+        auto alloc = val.get_allocator();
         for (size_t i = 0; i < map.cardinality(); ++i)
         {
-            KeyT k;
-            ValueT v;
+            auto k = std::make_obj_using_allocator<KeyT>(alloc);
+            auto v = std::make_obj_using_allocator<ValueT>(alloc);
             map >> k >> v;
-            val[k] = std::move(v);
+            val.insert_or_assign(std::move(k), std::move(v));
         }
         return *this;
     }
 
     template <typename... Args>
-    mp_reader& operator>> (std::tuple<Args...> &val)
+    mp_unchecked_reader& operator>> (std::tuple<Args...> &val)
     {
-        auto arr = read<mp_reader<mp_array>>();
+        auto arr = read<mp_unchecked_reader<mp_array>>();
         std::apply(
             [&arr](auto&... item)
             {
@@ -911,9 +2817,9 @@ public:
     }
 
     template <typename... Args>
-    mp_reader& operator>> (std::tuple<Args&...> val)
+    mp_unchecked_reader& operator>> (std::tuple<Args&...> val)
     {
-        auto arr = read<mp_reader<mp_array>>();
+        auto arr = read<mp_unchecked_reader<mp_array>>();
         std::apply(
             [&arr](auto&... item)
             {
@@ -924,26 +2830,25 @@ public:
         return *this;
     }
 
-    mp_reader& operator>> (mp_reader<mp_plain> &val)  = delete;
-
-    mp_reader& operator>> (mp_reader<mp_array> &val)
+    mp_unchecked_reader& operator>> (mp_unchecked_reader<mp_array> &val) noexcept
     {
-        val._mp = mp_array(_current_pos);
-        val._current_pos = val._mp.begin;
-        val._current_ind = 0;
-        skip();
-        if (!val._mp.end)
-            val._mp.end = _current_pos;
+        assert(mp_typeof(*_current_pos) == MP_ARRAY);
+        const char *head = _current_pos;
+        size_t cardinality = mp_decode_array(&head);
+        mp_next(&_current_pos);
+        ++_current_ind;
+        val = mp_unchecked_reader<mp_array>{mp_array{head, _current_pos, cardinality}};
         return *this;
     }
 
-    mp_reader& operator>> (mp_reader<mp_map> &val)
+    mp_unchecked_reader& operator>> (mp_unchecked_reader<mp_map> &val) noexcept
     {
-        val._mp = mp_map(_current_pos);
-        val._current_pos = val._mp.begin;
-        val._current_ind = 0;
-        skip();
-        val._mp.end = _current_pos;
+        assert(mp_typeof(*_current_pos) == MP_MAP);
+        const char *head = _current_pos;
+        size_t cardinality = mp_decode_map(&head);
+        mp_next(&_current_pos);
+        ++_current_ind;
+        val = mp_unchecked_reader<mp_map>{mp_map{head, _current_pos, cardinality}};
         return *this;
     }
 
@@ -955,118 +2860,14 @@ public:
         return res;
     }
 
-    template <size_t maxN>
-    const mp_span<maxN> read()
-    {
-        mp_span<maxN> dst{};
-        *this >> dst;
-        return dst;
-    }
-
     template <typename... Args>
-    mp_reader& values(Args&... args)
+    mp_unchecked_reader& values(Args&... args)
     {
         ((*this) >> ... >> args);
         return *this;
     }
-
-    template <typename T>
-    bool equals(const T &val) const
-    {
-        if (!has_next())
-            throw mp_reader_error("read out of bounds", _mp);
-        auto begin = _current_pos;
-        //auto end = begin;
-        //mp_next(&end);
-        //mp_reader tmp(begin, end);
-        mp_reader tmp(_current_pos);
-
-        auto type = mp_typeof(*_current_pos);
-        if constexpr (std::is_same_v<T, bool>)
-        {
-            return type == MP_BOOL && val == tmp.read<T>();
-        }
-        else if constexpr (std::is_enum_v<T> || (std::is_integral_v<T> && sizeof(T) < 16))
-        {
-            if (type == MP_UINT && val >= 0)
-            {
-                uint64_t res = mp_decode_uint(&begin);
-                return res == static_cast<uint64_t>(val);
-            }
-            else if (type == MP_INT)
-            {
-                int64_t res = mp_decode_int(&begin);
-                if (res < 0 && val < 0)
-                    return res == val;
-                if (res >= 0 && val >= 0)
-                    return static_cast<uint64_t>(res) == static_cast<uint64_t>(val);
-            }
-        }
-        else if constexpr (std::is_floating_point_v<T>)
-        {
-            //if (isnan(val))
-            //    return type == MP_NIL;
-            if (type == MP_FLOAT)
-                return val == mp_decode_float(&begin);
-            if (type == MP_DOUBLE)
-                return val == mp_decode_double(&begin);
-        }
-        else if constexpr (std::is_same_v<T, std::string_view>)
-        {
-            if (val.data() == nullptr)
-                return type == MP_NIL;
-            else if (type == MP_STR)
-                return val == tmp.read<std::string_view>();
-        }
-        else if constexpr (std::is_same_v<T, std::string>)
-        {
-            if (type == MP_STR)
-                return val == tmp.read<std::string_view>();
-        }
-        else if constexpr (std::is_same_v<typename std::decay_t<T>, char *>)
-        {
-            if (val == nullptr)
-                return type == MP_NIL;
-            else if (type == MP_STR)
-                return val == tmp.read<std::string_view>();
-        }
-        else
-        {
-            throw mp_reader_error("unsupported value type to compare with", _mp);
-        }
-
-        return false;
-    }
-
 };
 
-template <size_t maxN>
-mp_span<maxN>::mp_span(const char *begin, const char *end) : mp_array(begin, end, 0)
-{
-    auto r = mp_reader{mp_plain{begin, end}};
-    r >> *this;
-}
-
-template <typename T>
-mp_plain mp_map::find(const T &key) const
-{
-    auto tmp = mp_reader{mp_plain(begin, end)};
-    auto n = cardinality;
-    while (n-- > 0)
-    {
-        bool found = tmp.equals(key);
-        tmp.skip(); // skip a key
-
-        auto value_begin = tmp.pos();
-        tmp.skip();
-        auto value_end = tmp.pos();
-
-        if (found)
-            return {value_begin, value_end};
-    }
-    return {nullptr, nullptr};
-}
-
 template <typename MP>
 std::string hex_dump_mp(const MP &mp, const char *pos)
 {
@@ -1088,3 +2889,6 @@ std::string hex_dump_mp(const MP &mp, const char *pos)
 using mp_plain_reader = mp_reader<mp_plain>;
 using mp_array_reader = mp_reader<mp_array>;
 using mp_map_reader = mp_reader<mp_map>;
+using mp_plain_unchecked_reader = mp_unchecked_reader<mp_plain>;
+using mp_array_unchecked_reader = mp_unchecked_reader<mp_array>;
+using mp_map_unchecked_reader = mp_unchecked_reader<mp_map>;
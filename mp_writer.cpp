@@ -1,6 +1,7 @@
 #include "msgpuck/msgpuck.h"
 #include "mp_writer.h"
 #include "mp_reader.h"
+#include <cstring>
 
 using namespace std;
 
@@ -9,6 +10,7 @@ mp_writer::mp_writer(wtf_buffer &buf) : _buf(buf) {}
 void mp_writer::begin_array(uint32_t max_cardinality)
 {
     increment_container_counter();
+    ensure(5);
 
     _opened_containers.push({_buf.size(), max_cardinality});
     _buf.end = mp_encode_array(_buf.end, max_cardinality);
@@ -17,6 +19,7 @@ void mp_writer::begin_array(uint32_t max_cardinality)
 void mp_writer::begin_map(uint32_t max_cardinality)
 {
     increment_container_counter();
+    ensure(5);
     _opened_containers.push({_buf.size(), max_cardinality});
     _buf.end = mp_encode_map(_buf.end, max_cardinality);
 }
@@ -29,10 +32,8 @@ void mp_writer::finalize()
     auto &c = _opened_containers.pop();
     char *head = _buf.data() + c.head_offset;
 
-    // mp_encode_array() may reduce header's size if actual cardinality
-    // is smaller than initial value, so we update the header directly
-
-    uint32_t max_num_bytes = 0;
+    uint32_t reserved_header_size = 0;
+    uint32_t required_header_size = 0;
     uint32_t actual_cardinality = c.items_count;
     auto container_type = mp_typeof(*head);
 
@@ -40,22 +41,8 @@ void mp_writer::finalize()
     {
         if (actual_cardinality == c.max_cardinality)
             return;
-
-        // get current header size
-        max_num_bytes = mp_sizeof_array(c.max_cardinality);
-
-        if (actual_cardinality > c.max_cardinality && mp_sizeof_array(actual_cardinality) > max_num_bytes)
-            throw overflow_error("array header size exceeded");
-            //throw overflow_error(std::format("array header size exceeded ({} of {})\n{}\n{}",
-            //             actual_cardinality, c.max_cardinality,
-            //             get_trace(), hex_dump(_buf.data(), _buf.end, head)));
-
-        if (max_num_bytes == 1)
-        {
-            // replace 1-byte header with the new size
-            mp_encode_array(head, actual_cardinality);
-            return;
-        }
+        reserved_header_size = mp_sizeof_array(c.max_cardinality);
+        required_header_size = mp_sizeof_array(actual_cardinality);
     }
     else if (container_type == MP_MAP)
     {
@@ -65,36 +52,31 @@ void mp_writer::finalize()
         actual_cardinality = c.items_count / 2; // map cardinality
         if (actual_cardinality == c.max_cardinality)
             return;
-
-        // get current header size
-        max_num_bytes = mp_sizeof_map(c.max_cardinality);
-
-        if (actual_cardinality > c.max_cardinality && mp_sizeof_map(actual_cardinality) > max_num_bytes)
-            throw overflow_error("map header size exceeded");
-
-        if (max_num_bytes == 1)
-        {
-            // replace 1-byte header with new size
-            mp_encode_map(head, actual_cardinality);
-            return;
-        }
+        reserved_header_size = mp_sizeof_map(c.max_cardinality);
+        required_header_size = mp_sizeof_map(actual_cardinality);
     }
     else
     {
         throw runtime_error("unexpected container header");
     }
 
-    switch (max_num_bytes)
+    // Keep the encoding minimal: move the container's body if the actual
+    // cardinality needs a header of another size than reserved one.
+    if (required_header_size != reserved_header_size)
     {
-    case 3:
-        mp_store_u16(++head, static_cast<uint16_t>(actual_cardinality));
-        break;
-    case 5:
-        mp_store_u32(++head, actual_cardinality);
-        break;
-    default:
-        throw runtime_error("previously not implemented container cardinality");
+        size_t body_offset = c.head_offset + reserved_header_size;
+        size_t body_size = _buf.size() - body_offset;
+        if (required_header_size > reserved_header_size)
+            ensure(required_header_size - reserved_header_size);
+        head = _buf.data() + c.head_offset;
+        memmove(head + required_header_size, head + reserved_header_size, body_size);
+        _buf.end = head + required_header_size + body_size;
     }
+
+    if (container_type == MP_ARRAY)
+        mp_encode_array(head, actual_cardinality);
+    else
+        mp_encode_map(head, actual_cardinality);
 }
 
 void mp_writer::finalize_all()
@@ -103,6 +85,11 @@ void mp_writer::finalize_all()
         finalize();
 }
 
+void mp_writer::grow(size_t size)
+{
+    _buf.reserve(std::max(_buf.size() + size, _buf.capacity() + _buf.capacity() / 2));
+}
+
 void mp_writer::increment_container_counter(size_t items_added)
 {
     if (!_opened_containers.empty())
@@ -112,9 +99,8 @@ void mp_writer::increment_container_counter(size_t items_added)
 void mp_writer::write(const char *begin, const char *end, size_t cardinality)
 {
     // make sure the destination has free space
-    auto dst = _buf.end;
-    _buf.resize(_buf.size() + end - begin);
-    std::copy(begin, end, dst);
+    ensure(end - begin);
+    _buf.end = std::copy(begin, end, _buf.end);
 
     if (!_opened_containers.empty())
     {
@@ -148,6 +134,7 @@ mp_writer &mp_writer::fill(mp_raw_view items_to_fill, uint32_t target_items_coun
 
 mp_writer &mp_writer::operator<<(nullptr_t)
 {
+    ensure(1);
     _buf.end = mp_encode_nil(_buf.end);
     increment_container_counter();
     return *this;
@@ -170,11 +157,19 @@ mp_writer::state mp_writer::get_state()
 mp_writer& mp_writer::operator<<(const string_view &val)
 {
     if (val.data() == nullptr)
+    {
+        ensure(1);
         _buf.end = mp_encode_nil(_buf.end);
+    }
     else if (val.size() > std::numeric_limits<uint32_t>::max())
+    {
         throw overflow_error("too long string");
+    }
     else
+    {
+        ensure(mp_sizeof_str(static_cast<uint32_t>(val.size())));
         _buf.end = mp_encode_str(_buf.end, val.data(), static_cast<uint32_t>(val.size()));
+    }
 
     increment_container_counter();
     return *this;
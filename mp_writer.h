@@ -4,7 +4,12 @@
 #include <string_view>
 #include <stdexcept>
 #include <optional>
+#include <algorithm>
 #include <array>
+#include <bit>
+#include <span>
+#include <ranges>
+#include <vector>
 #include <map>
 #include <cmath>
 #include "mp_reader.h"
@@ -51,9 +56,222 @@ inline constexpr mp_raw_view operator ""_mp(const char* data, size_t size)
     return mp_raw_view{data, size};
 }
 
+/// String literal usable as a template argument (see mp_static).
+template <size_t N>
+struct mp_fixed_string
+{
+    constexpr mp_fixed_string(const char (&str)[N])
+    {
+        std::copy_n(str, N, data);
+    }
+    constexpr size_t size() const noexcept
+    {
+        return N - 1;
+    }
+    char data[N];
+};
+
+/// String constant for mp_static and iproto_writer::static_call(), e.g. `mp_static<"abc"_fs>`
+/// (a bare string literal can't be passed as `auto` template argument).
+template <mp_fixed_string S>
+constexpr auto operator ""_fs() noexcept
+{
+    return S;
+}
+
+/// Array header to be encoded at compile time (see mp_static).
+struct mp_array_header
+{
+    uint32_t cardinality;
+};
+
+/// Map header to be encoded at compile time (see mp_static).
+struct mp_map_header
+{
+    uint32_t cardinality;
+};
+
+/// Compile-time analogue of mp_sizeof_*().
+template <typename T>
+constexpr size_t mp_static_sizeof(const T &val) noexcept
+{
+    auto uint_size = [](uint64_t v) -> size_t {
+        return v <= 0x7f ? 1 : v <= 0xff ? 2 : v <= 0xffff ? 3 : v <= 0xffffffff ? 5 : 9;
+    };
+    auto container_size = [](uint32_t n) -> size_t {
+        return n <= 15 ? 1 : n <= 0xffff ? 3 : 5;
+    };
+
+    if constexpr (std::is_same_v<T, std::nullptr_t> || std::is_same_v<T, bool>)
+        return 1;
+    else if constexpr (std::is_enum_v<T>)
+        return mp_static_sizeof(static_cast<std::underlying_type_t<T>>(val));
+    else if constexpr (std::is_integral_v<T>)
+    {
+        if (val >= 0)
+            return uint_size(static_cast<uint64_t>(val));
+        int64_t v = val;
+        return v >= -0x20 ? 1 : v >= INT8_MIN ? 2 : v >= INT16_MIN ? 3 : v >= INT32_MIN ? 5 : 9;
+    }
+    else if constexpr (std::is_floating_point_v<T>)
+        return sizeof(T) <= 4 ? 5 : 9;
+    else if constexpr (std::is_same_v<T, mp_array_header> || std::is_same_v<T, mp_map_header>)
+        return container_size(val.cardinality);
+    else
+        return (val.size() <= 31 ? 1 : val.size() <= 0xff ? 2 : val.size() <= 0xffff ? 3 : 5) + val.size();
+}
+
+/// Compile-time analogue of mp_encode_*() (the same encoding as mp_writer produces).
+template <typename T>
+constexpr char* mp_static_encode(char *dst, const T &val) noexcept
+{
+    auto store = [](char *dst, uint8_t code, uint64_t v, size_t len) {
+        *dst++ = static_cast<char>(code);
+        for (size_t i = len; i-- > 0;)
+            *dst++ = static_cast<char>((v >> (i * 8)) & 0xff);
+        return dst;
+    };
+    auto encode_uint = [&store](char *dst, uint64_t v) {
+        if (v <= 0x7f)
+        {
+            *dst = static_cast<char>(v);
+            return dst + 1;
+        }
+        return v <= 0xff ? store(dst, 0xcc, v, 1) :
+               v <= 0xffff ? store(dst, 0xcd, v, 2) :
+               v <= 0xffffffff ? store(dst, 0xce, v, 4) : store(dst, 0xcf, v, 8);
+    };
+    auto encode_container = [&store](char *dst, uint8_t fix, uint8_t code16, uint32_t n) {
+        if (n <= 15)
+        {
+            *dst = static_cast<char>(fix | n);
+            return dst + 1;
+        }
+        return n <= 0xffff ? store(dst, code16, n, 2) : store(dst, code16 + 1, n, 4);
+    };
+
+    if constexpr (std::is_same_v<T, std::nullptr_t>)
+    {
+        *dst = static_cast<char>(0xc0);
+        return dst + 1;
+    }
+    else if constexpr (std::is_same_v<T, bool>)
+    {
+        *dst = static_cast<char>(val ? 0xc3 : 0xc2);
+        return dst + 1;
+    }
+    else if constexpr (std::is_enum_v<T>)
+        return mp_static_encode(dst, static_cast<std::underlying_type_t<T>>(val));
+    else if constexpr (std::is_integral_v<T>)
+    {
+        if (val >= 0)
+            return encode_uint(dst, static_cast<uint64_t>(val));
+        int64_t v = val;
+        if (v >= -0x20)
+        {
+            *dst = static_cast<char>(static_cast<uint8_t>(v));
+            return dst + 1;
+        }
+        auto u = static_cast<uint64_t>(v);
+        return v >= INT8_MIN ? store(dst, 0xd0, u, 1) :
+               v >= INT16_MIN ? store(dst, 0xd1, u, 2) :
+               v >= INT32_MIN ? store(dst, 0xd2, u, 4) : store(dst, 0xd3, u, 8);
+    }
+    else if constexpr (std::is_floating_point_v<T>)
+    {
+        if constexpr (sizeof(T) <= 4)
+            return store(dst, 0xca, std::bit_cast<uint32_t>(static_cast<float>(val)), 4);
+        else
+            return store(dst, 0xcb, std::bit_cast<uint64_t>(static_cast<double>(val)), 8);
+    }
+    else if constexpr (std::is_same_v<T, mp_array_header>)
+        return encode_container(dst, 0x90, 0xdc, val.cardinality);
+    else if constexpr (std::is_same_v<T, mp_map_header>)
+        return encode_container(dst, 0x80, 0xde, val.cardinality);
+    else
+    {
+        size_t len = val.size();
+        if (len <= 31)
+            *dst++ = static_cast<char>(0xa0 | len);
+        else
+            dst = len <= 0xff ? store(dst, 0xd9, len, 1) : len <= 0xffff ? store(dst, 0xda, len, 2) : store(dst, 0xdb, len, 4);
+        return std::copy_n(val.data, len, dst);
+    }
+}
+
+/// Encode `Values` (integers, enums, floating point, bool, nullptr, string literals,
+/// mp_array_header, mp_map_header) into a byte array at compile time.
+template <auto... Values>
+constexpr auto mp_static_encode_all() noexcept
+{
+    std::array<char, (mp_static_sizeof(Values) + ... + 0)> res{};
+    char *dst = res.data();
+    ((dst = mp_static_encode(dst, Values)), ...);
+    return res;
+}
+
+template <auto... Values>
+inline constexpr auto mp_static_bytes = mp_static_encode_all<Values...>();
+
+/// Number of top level items within `Values` (headers own the subsequent items).
+template <auto... Values>
+constexpr size_t mp_static_cardinality() noexcept
+{
+    size_t res = 0;
+    std::array<uint64_t, sizeof...(Values) + 1> remains{}; // items left within nested containers
+    size_t depth = 0;
+    [[maybe_unused]] auto add = [&](const auto &val) { // unused for an empty pack
+        using T = std::remove_cvref_t<decltype(val)>;
+        if (depth)
+            --remains[depth - 1];
+        else
+            ++res;
+
+        uint64_t n = 0;
+        if constexpr (std::is_same_v<T, mp_array_header>)
+            n = val.cardinality;
+        else if constexpr (std::is_same_v<T, mp_map_header>)
+            n = uint64_t(val.cardinality) * 2;
+        if (n)
+            remains[depth++] = n;
+        while (depth && !remains[depth - 1])
+            --depth;
+    };
+    (add(Values), ...);
+    return res;
+}
+
+/// Msgpack items encoded at compile time, e.g. `writer << mp_static<1, "abc"_fs, mp_array_header{2}, 5, nullptr>`.
+template <auto... Values>
+inline constexpr mp_raw_view mp_static =
+    mp_raw_view(mp_static_bytes<Values...>.data(), mp_static_bytes<Values...>.size()).c(mp_static_cardinality<Values...>());
+
+template <typename T>
+inline constexpr bool mp_is_vector_or_map_v = false;
+template <typename T, typename A>
+inline constexpr bool mp_is_vector_or_map_v<std::vector<T, A>> = true;
+template <typename K, typename V, typename C, typename A>
+inline constexpr bool mp_is_vector_or_map_v<std::map<K, V, C, A>> = true;
+
+template <typename T>
+inline constexpr bool mp_is_bulk_span_v = false;
+template <typename T, size_t E>
+inline constexpr bool mp_is_bulk_span_v<std::span<T, E>> = mp_bulk_numeric_v<std::remove_const_t<T>>;
+
+/** Ranges serialized by dedicated mp_writer overloads (strings, vectors, maps, numeric spans)
+ *  are excluded, as well as ranges of char: those are raw bytes (e.g. mp_reader), not arrays. */
+template <typename R>
+concept mp_generic_range =
+    std::ranges::input_range<R> &&
+    !std::is_same_v<std::remove_cv_t<std::ranges::range_value_t<R>>, char> &&
+    !std::is_convertible_v<R, std::string_view> &&
+    !mp_is_vector_or_map_v<std::remove_cvref_t<R>> &&
+    !mp_is_bulk_span_v<std::remove_cvref_t<R>>;
+
 /** msgpuck wrapper.
  *
- * A caller must ensure there is enough free space in the buffer.
+ * The buffer grows automatically (geometrically). A caller writing via buf().end
+ * directly must call ensure() beforehand.
  */
 class mp_writer
 {
@@ -70,17 +288,27 @@ public:
     mp_writer(wtf_buffer &buf);
     /// Put array header with <max_size> cardinality and move current position over it.
     /// A caller must call finalize() to close the array and actualize its initial size.
+    /// <max_size> is just an estimation: the header is resized within finalize() if needed.
     void begin_array(uint32_t max_cardinality);
     /// Put map header with <max_size> cardinality and move current position over it.
     /// A caller must call finalize() to close the map and actualize its initial size.
+    /// <max_size> is just an estimation: the header is resized within finalize() if needed.
     void begin_map(uint32_t max_cardinality);
     /// Replace initial cardinality settled with begin_array(), begin_map() with actual
-    /// value (counted untill now).
+    /// value (counted untill now). The header gets minimal size: if it differs from
+    /// the reserved one, the container's body is moved (the buffer may grow by 4 bytes max).
     void finalize();
     /// Finalize all non-finalized containers (if exists).
     void finalize_all();
     /// Function to be used in custom serializers (e.g. operator << overload).
     void increment_container_counter(size_t items_added = 1);
+    /// Make sure the buffer has at least `size` bytes available (it grows by 1.5x at least).
+    /// Function to be used in custom serializers before writing via buf().end.
+    inline void ensure(size_t size)
+    {
+        if (_buf.available() < size) [[unlikely]]
+            grow(size);
+    }
 
     /// Append msgpack buffer.
     void write(const char *begin, const char *end, size_t cardinality = 0);
@@ -139,11 +367,23 @@ public:
         return *this;
     }
 
+    /// Tarantool extension value (mp_decimal, mp_uuid, mp_datetime, mp_interval).
+    template <mp_ext_value T>
+    mp_writer& operator<< (const T &val)
+    {
+        uint32_t len = val.payload_size();
+        ensure(mp_sizeof_ext(len));
+        _buf.end = val.encode_payload(mp_encode_extl(_buf.end, T::ext_type, len));
+        increment_container_counter();
+        return *this;
+    }
+
     template <typename T>
-    mp_writer& operator<< (const std::optional<T> &val) noexcept
+    mp_writer& operator<< (const std::optional<T> &val)
     {
         if (!val.has_value())
         {
+            ensure(1);
             _buf.end = mp_encode_nil(_buf.end);
 
             if (!_opened_containers.empty())
@@ -160,6 +400,7 @@ public:
                    >>
     mp_writer& operator<< (const T &val)
     {
+        ensure(9);
         if constexpr (std::is_same_v<T, bool>)
         {
             _buf.end = mp_encode_bool(_buf.end, val);
@@ -168,7 +409,7 @@ public:
         {
             if constexpr (sizeof(T) <= 4)
                 _buf.end = mp_encode_float(_buf.end, val);
-            else if (!std::isfinite(val) || (val <= std::numeric_limits<double>::max() && val >= std::numeric_limits<double>::min()))
+            else if (!std::isfinite(val) || (val <= std::numeric_limits<double>::max() && val >= std::numeric_limits<double>::lowest()))
                 _buf.end = mp_encode_double(_buf.end, static_cast<double>(val));
             else
                 throw std::overflow_error("unable to fit floating point value into msgpack");
@@ -188,6 +429,7 @@ public:
     template <typename T>
     mp_writer& operator<< (const strict_uint<T> &val)
     {
+        ensure(9);
         if constexpr (sizeof(T) == 2)
         {
             _buf.end = mp_store_u8(_buf.end, 0xcd);
@@ -250,9 +492,111 @@ public:
 
     mp_writer& operator<< (const mp_plain &src);
 
+    /** Contiguous numeric data is encoded in bulk: single array header and counter update,
+     *  uniform element encoding (the narrowest one fitting all the values) written
+     *  by tight byte swap loops. Integers with negative values are encoded per item
+     *  (the shortest form) as tarantool treats signed encodings as negative numbers. */
     template <typename T>
-    mp_writer& operator<< (const std::vector<T> &val)
+        requires mp_bulk_numeric_v<T>
+    mp_writer& operator<< (std::span<const T> val)
     {
+        if (val.size() > std::numeric_limits<uint32_t>::max())
+            throw std::overflow_error("too long array");
+        size_t n = val.size();
+        const T *src = val.data();
+
+        auto reserve = [this](size_t item_size, size_t n) {
+            size_t need = mp_sizeof_array(static_cast<uint32_t>(n)) + item_size * n;
+            ensure(need);
+            _buf.end = mp_encode_array(_buf.end, static_cast<uint32_t>(n));
+        };
+
+        if constexpr (std::is_floating_point_v<T>)
+        {
+            if constexpr (sizeof(T) <= 4)
+            {
+                reserve(5, n);
+                _buf.end = store_run<uint32_t>(_buf.end, 0xca, src, n);
+            }
+            else
+            {
+                for (size_t i = 0; i < n; ++i)
+                {
+                    if (std::isfinite(src[i]) && (src[i] > std::numeric_limits<double>::max() ||
+                                                  src[i] < std::numeric_limits<double>::lowest()))
+                        throw std::overflow_error("unable to fit floating point value into msgpack");
+                }
+                reserve(9, n);
+                _buf.end = store_run<uint64_t>(_buf.end, 0xcb, src, n);
+            }
+        }
+        else
+        {
+            T min = 0, max = 0;
+            if (n)
+                min = max = src[0];
+            for (size_t i = 1; i < n; ++i)
+            {
+                min = std::min(min, src[i]);
+                max = std::max(max, src[i]);
+            }
+
+            if (min < 0)
+            {
+                reserve(9, n);
+                for (size_t i = 0; i < n; ++i)
+                {
+                    _buf.end = (src[i] >= 0 ?
+                                mp_encode_uint(_buf.end, static_cast<uint64_t>(src[i])) :
+                                mp_encode_int(_buf.end, src[i]));
+                }
+            }
+            else if (static_cast<uint64_t>(max) <= 0x7f)
+            {
+                reserve(1, n);
+                for (size_t i = 0; i < n; ++i)
+                    _buf.end[i] = static_cast<char>(src[i]);
+                _buf.end += n;
+            }
+            else if (static_cast<uint64_t>(max) <= 0xff)
+            {
+                reserve(2, n);
+                _buf.end = store_run<uint8_t>(_buf.end, 0xcc, src, n);
+            }
+            else if (static_cast<uint64_t>(max) <= 0xffff)
+            {
+                reserve(3, n);
+                _buf.end = store_run<uint16_t>(_buf.end, 0xcd, src, n);
+            }
+            else if (static_cast<uint64_t>(max) <= 0xffffffff)
+            {
+                reserve(5, n);
+                _buf.end = store_run<uint32_t>(_buf.end, 0xce, src, n);
+            }
+            else
+            {
+                reserve(9, n);
+                _buf.end = store_run<uint64_t>(_buf.end, 0xcf, src, n);
+            }
+        }
+
+        increment_container_counter();
+        return *this;
+    }
+
+    /// Mutable and fixed-extent spans.
+    template <typename T, size_t E>
+        requires mp_bulk_numeric_v<std::remove_const_t<T>> && (!std::is_const_v<T> || E != std::dynamic_extent)
+    mp_writer& operator<< (std::span<T, E> val)
+    {
+        return *this << std::span<const std::remove_const_t<T>>(val);
+    }
+
+    template <typename T, typename Alloc>
+    mp_writer& operator<< (const std::vector<T, Alloc> &val)
+    {
+        if constexpr (mp_bulk_numeric_v<T>)
+            return *this << std::span<const T>(val);
         begin_array(val.size());
         for (const auto& elem: val)
             *this << elem;
@@ -260,8 +604,32 @@ public:
         return *this;
     }
 
-    template <typename KeyT, typename ValueT>
-    mp_writer& operator<< (const std::map<KeyT, ValueT> &val)
+    /** Any other range (containers, views, generators) is serialized as an array
+     *  without intermediate containers. Sized ranges get the exact header,
+     *  the others get the one actualized within finalize(). */
+    template <typename R>
+        requires mp_generic_range<R>
+    mp_writer& operator<< (R &&val)
+    {
+        if constexpr (std::ranges::sized_range<R>)
+        {
+            auto n = std::ranges::size(val);
+            if (n > std::numeric_limits<uint32_t>::max())
+                throw std::overflow_error("too long array");
+            begin_array(static_cast<uint32_t>(n));
+        }
+        else
+        {
+            begin_array(0);
+        }
+        for (auto &&item: val)
+            *this << item;
+        finalize();
+        return *this;
+    }
+
+    template <typename KeyT, typename ValueT, typename Compare, typename Alloc>
+    mp_writer& operator<< (const std::map<KeyT, ValueT, Compare, Alloc> &val)
     {
         begin_map(val.size());
         for (const auto& elem: val)
@@ -274,27 +642,95 @@ public:
     }
 
 protected:
+    void grow(size_t size);
+
+    /// Store `n` values as `code` + big-endian U (U is unsigned of the item size).
+    template <typename U, typename T>
+    static char* store_run(char *dst, uint8_t code, const T *src, size_t n) noexcept
+    {
+        constexpr size_t stride = sizeof(U) + 1;
+        for (size_t i = 0; i < n; ++i)
+        {
+            char *p = dst + i * stride;
+            *p = static_cast<char>(code);
+            if constexpr (std::is_floating_point_v<T>)
+            {
+                using F = std::conditional_t<sizeof(U) == 4, float, double>;
+                U bits = std::bit_cast<U>(static_cast<F>(src[i]));
+                if constexpr (sizeof(U) == 4)
+                    mp_store_u32(p + 1, bits);
+                else
+                    mp_store_u64(p + 1, bits);
+            }
+            else if constexpr (sizeof(U) == 1)
+                mp_store_u8(p + 1, static_cast<U>(src[i]));
+            else if constexpr (sizeof(U) == 2)
+                mp_store_u16(p + 1, static_cast<U>(src[i]));
+            else if constexpr (sizeof(U) == 4)
+                mp_store_u32(p + 1, static_cast<U>(src[i]));
+            else
+                mp_store_u64(p + 1, static_cast<U>(src[i]));
+        }
+        return dst + n * stride;
+    }
+
+    /** Stack of opened containers. The first N levels are kept inline,
+     *  deeper ones spill to the heap. Copies (see state) take only the used depth. */
     template <typename T, std::size_t N = 16>
     class wtf_stack
     {
     private:
         std::array<T, N> _items;
+        std::vector<T> _spill; ///< levels beyond N
         size_t _size = 0;
+
+        T& at(size_t i) noexcept
+        {
+            return i < N ? _items[i] : _spill[i - N];
+        }
+        void assign(const wtf_stack &other)
+        {
+            std::copy_n(other._items.begin(), std::min(other._size, N), _items.begin());
+            if (other._size > N)
+                _spill.assign(other._spill.begin(), other._spill.begin() + (other._size - N));
+            else
+                _spill.clear();
+            _size = other._size;
+        }
     public:
         wtf_stack() = default;
+        wtf_stack(const wtf_stack &other)
+        {
+            assign(other);
+        }
+        wtf_stack& operator=(const wtf_stack &other)
+        {
+            if (this != &other)
+                assign(other);
+            return *this;
+        }
+        wtf_stack(wtf_stack&&) = default;
+        wtf_stack& operator=(wtf_stack&&) = default;
+
         void push(T &&value)
         {
-            _items[_size++] = std::move(value);
+            if (_size < N)
+                _items[_size] = std::move(value);
+            else if (_size - N < _spill.size())
+                _spill[_size - N] = std::move(value);
+            else
+                _spill.push_back(std::move(value));
+            ++_size;
         }
         T& pop() noexcept  // undefined if empty
         {
             if (!_size)
                 return _items[_size];
-            return _items[--_size];
+            return at(--_size);
         }
         T& top() noexcept  // undefined if empty
         {
-            return  _items[_size ? _size - 1 : _size];
+            return at(_size ? _size - 1 : _size);
         }
         size_t size() const noexcept
         {
@@ -0,0 +1,75 @@
+#include "schema.h"
+
+using namespace std;
+
+/// Tarantool connector scope
+namespace tnt
+{
+
+const space_info* schema::space(string_view name) const
+{
+    auto it = _by_name.find(name);
+    return it == _by_name.end() ? nullptr : it->second;
+}
+
+const space_info* schema::space(uint32_t id) const
+{
+    auto it = _by_id.find(id);
+    return it == _by_id.end() ? nullptr : it->second;
+}
+
+void schema::load(mp_plain vspace_data, mp_plain vindex_data, uint64_t version)
+{
+    schema res;
+    res._version = version;
+
+    // _vspace: [id, owner, name, engine, field_count, flags, format]
+    auto spaces = mp_reader(vspace_data).read<mp_array_reader>();
+    res._spaces.reserve(spaces.cardinality());
+    while (spaces.has_next())
+    {
+        auto tuple = spaces.read<mp_array_reader>();
+        auto s = make_unique<space_info>();
+        tuple >> s->id >> mp_none() >> s->name >> s->engine >> mp_none<2>();
+        if (tuple.has_next())
+        {
+            auto format = tuple.read<mp_array_reader>();
+            s->field_names.reserve(format.cardinality());
+            while (format.has_next())
+            {
+                auto field = format.read<mp_map_reader>();
+                auto name = field.find("name");
+                s->field_names.emplace_back(name.pos() ? name.read<string_view>() : string_view{});
+                if (!s->field_names.back().empty())
+                    s->fields.try_emplace(s->field_names.back(), static_cast<uint32_t>(s->field_names.size() - 1));
+            }
+        }
+        res._by_id.try_emplace(s->id, s.get());
+        res._by_name.try_emplace(s->name, s.get());
+        res._spaces.push_back(std::move(s));
+    }
+
+    // _vindex: [space_id, index_id, name, type, opts, parts]
+    auto indexes = mp_reader(vindex_data).read<mp_array_reader>();
+    while (indexes.has_next())
+    {
+        auto tuple = indexes.read<mp_array_reader>();
+        uint32_t space_id, index_id;
+        string_view name;
+        tuple >> space_id >> index_id >> name;
+        if (auto it = res._by_id.find(space_id); it != res._by_id.end())
+            it->second->indexes.try_emplace(string(name), index_id);
+    }
+
+    *this = std::move(res);
+}
+
+void schema::clear() noexcept
+{
+    _version = 0;
+    _by_name.clear();
+    _by_id.clear();
+    _spaces.clear();
+}
+
+} // namespace tnt
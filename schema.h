@@ -0,0 +1,113 @@
+#ifndef TNT_SCHEMA_H
+#define TNT_SCHEMA_H
+
+/** @file */
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "mp_reader.h"
+
+/// Tarantool connector scope
+namespace tnt
+{
+
+constexpr uint32_t VSPACE_ID = 281;  ///< _vspace system view
+constexpr uint32_t VINDEX_ID = 289;  ///< _vindex system view
+
+/// Transparent string hash to look up std::string keys by std::string_view.
+struct string_hash
+{
+    using is_transparent = void;
+    size_t operator()(std::string_view s) const noexcept
+    {
+        return std::hash<std::string_view>{}(s);
+    }
+};
+
+using name_map = std::unordered_map<std::string, uint32_t, string_hash, std::equal_to<>>;
+
+/// Space definition (a subset of _vspace and _vindex data).
+struct space_info
+{
+    uint32_t id = 0;
+    std::string name;
+    std::string engine;
+    std::vector<std::string> field_names;   ///< space format (may be empty)
+    name_map fields;                        ///< field name -> 0-based field number
+    name_map indexes;                       ///< index name -> index id
+
+    /// 0-based field number by its name.
+    std::optional<uint32_t> field_no(std::string_view field) const
+    {
+        auto it = fields.find(field);
+        return it == fields.end() ? std::nullopt : std::optional<uint32_t>(it->second);
+    }
+
+    std::optional<uint32_t> index_id(std::string_view index) const
+    {
+        auto it = indexes.find(index);
+        return it == indexes.end() ? std::nullopt : std::optional<uint32_t>(it->second);
+    }
+};
+
+/** Space and index catalog (see connection::set_schema_caching()).
+ *  Name lookups are hash-based, no allocation.
+ */
+class schema
+{
+public:
+    /// Schema version (header_field::SCHEMA_ID) the catalog was loaded at, 0 if not loaded.
+    uint64_t version() const noexcept
+    {
+        return _version;
+    }
+
+    bool empty() const noexcept
+    {
+        return _spaces.empty();
+    }
+
+    /// nullptr if not found
+    const space_info* space(std::string_view name) const;
+    /// nullptr if not found
+    const space_info* space(uint32_t id) const;
+
+    std::optional<uint32_t> space_id(std::string_view space) const
+    {
+        auto s = this->space(space);
+        return s ? std::optional<uint32_t>(s->id) : std::nullopt;
+    }
+
+    std::optional<uint32_t> index_id(std::string_view space, std::string_view index) const
+    {
+        auto s = this->space(space);
+        return s ? s->index_id(index) : std::nullopt;
+    }
+
+    std::optional<uint32_t> field_no(std::string_view space, std::string_view field) const
+    {
+        auto s = this->space(space);
+        return s ? s->field_no(field) : std::nullopt;
+    }
+
+    /** Replace the catalog with _vspace and _vindex select results
+     *  (IPROTO_DATA values, arrays of tuples). */
+    void load(mp_plain vspace_data, mp_plain vindex_data, uint64_t version);
+    void clear() noexcept;
+
+private:
+    uint64_t _version = 0;
+    std::vector<std::unique_ptr<space_info>> _spaces;
+    std::unordered_map<std::string_view, space_info*> _by_name;
+    std::unordered_map<uint32_t, space_info*> _by_id;
+};
+
+} // namespace tnt
+
+#endif // TNT_SCHEMA_H
@@ -0,0 +1,329 @@
+#include <algorithm>
+#include <limits>
+#include "sql.h"
+#include "iproto.h"
+
+using namespace std;
+
+/// Tarantool connector scope
+namespace tnt
+{
+
+namespace
+{
+
+/// Null cells get default values, so every column has a value per row.
+bool decode_null(mp_reader<mp_plain> &row, sql_column_data &dst)
+{
+    bool null = row.is_null();
+    dst.nulls.push_back(null);
+    if (null)
+        row.skip();
+    return null;
+}
+
+template <typename T>
+void decode_value(mp_reader<mp_plain> &row, sql_column_data &dst)
+{
+    auto &values = get<vector<T>>(dst.values);
+    if (decode_null(row, dst))
+    {
+        values.emplace_back();
+        return;
+    }
+    T value;
+    row >> value;
+    values.push_back(value);
+}
+
+/** SQL integer covers [-2^63, 2^64): the column is decoded as int64_t, widened to uint64_t
+ *  when a value exceeds INT64_MAX while nothing is negative, and left as raw values when
+ *  both occur (sql_result::columns() decodes such a column again with decode_any). */
+void decode_integer(mp_reader<mp_plain> &row, sql_column_data &dst)
+{
+    if (dst.kind == sql_type::any)
+    {
+        row.skip();
+        return;
+    }
+    auto mixed = [&dst]{
+        dst.kind = sql_type::any;
+        dst.nulls.clear();
+        dst.values = vector<mp_plain>{};
+    };
+
+    if (auto *values = get_if<vector<int64_t>>(&dst.values))
+    {
+        if (decode_null(row, dst))
+        {
+            values->emplace_back();
+            return;
+        }
+        if (mp_typeof(*row.pos()) != MP_UINT)
+        {
+            values->push_back(row.read<int64_t>());
+            return;
+        }
+        uint64_t value = row.read<uint64_t>();
+        if (value <= static_cast<uint64_t>(numeric_limits<int64_t>::max()))
+        {
+            values->push_back(static_cast<int64_t>(value));
+            return;
+        }
+        if (any_of(values->begin(), values->end(), [](int64_t v){ return v < 0; }))
+            return mixed();
+        vector<uint64_t> widened(values->begin(), values->end());
+        widened.reserve(values->capacity());
+        widened.push_back(value);
+        dst.kind = sql_type::unsigned_integer;
+        dst.values = std::move(widened);
+        return;
+    }
+
+    auto &values = get<vector<uint64_t>>(dst.values);
+    if (decode_null(row, dst))
+    {
+        values.emplace_back();
+        return;
+    }
+    if (mp_typeof(*row.pos()) == MP_UINT)
+    {
+        values.push_back(row.read<uint64_t>());
+        return;
+    }
+    int64_t value = row.read<int64_t>();
+    if (value < 0)
+        return mixed();
+    values.push_back(static_cast<uint64_t>(value));
+}
+
+void decode_number(mp_reader<mp_plain> &row, sql_column_data &dst)
+{
+    auto &values = get<vector<double>>(dst.values);
+    if (decode_null(row, dst))
+    {
+        values.emplace_back();
+        return;
+    }
+    // number columns hold integers as well
+    switch (mp_typeof(*row.pos()))
+    {
+    case MP_UINT:
+        values.push_back(static_cast<double>(row.read<uint64_t>()));
+        break;
+    case MP_INT:
+        values.push_back(static_cast<double>(row.read<int64_t>()));
+        break;
+    default:
+        values.push_back(row.read<double>());
+    }
+}
+
+void decode_varbinary(mp_reader<mp_plain> &row, sql_column_data &dst)
+{
+    auto &values = get<vector<string_view>>(dst.values);
+    if (decode_null(row, dst))
+    {
+        values.emplace_back();
+        return;
+    }
+    const char *data = row.pos();
+    if (mp_typeof(*data) != MP_BIN)
+        throw mp_reader_error("binary expected, got " + mpuck_type_name(mp_typeof(*data)), row.content(), data);
+    row.skip();
+    uint32_t len = 0;
+    data = mp_decode_bin(&data, &len);
+    values.emplace_back(data, len);
+}
+
+void decode_any(mp_reader<mp_plain> &row, sql_column_data &dst)
+{
+    const char *begin = row.pos();
+    get<vector<mp_plain>>(dst.values).emplace_back(begin, row.skip().pos());
+    dst.nulls.push_back(mp_typeof(*begin) == MP_NIL);
+}
+
+sql_type type_by_name(string_view type)
+{
+    if (type == "integer")
+        return sql_type::integer;
+    if (type == "unsigned")
+        return sql_type::unsigned_integer;
+    if (type == "number" || type == "double")
+        return sql_type::number;
+    if (type == "string" || type == "text")
+        return sql_type::string;
+    if (type == "boolean")
+        return sql_type::boolean;
+    if (type == "varbinary")
+        return sql_type::varbinary;
+    return sql_type::any;
+}
+
+} // namespace
+
+sql_metadata::sql_metadata(mp_plain metadata)
+{
+    auto columns = mp_reader(metadata).read<mp_array_reader>();
+    _columns.reserve(columns.cardinality());
+    _decoders.reserve(columns.cardinality());
+    while (columns.has_next())
+    {
+        auto field = columns.read<mp_map_reader>();
+        sql_column &c = _columns.emplace_back();
+        while (field.has_next())
+        {
+            switch (field.read<int>())
+            {
+            case SQL_FIELD_NAME:             field >> c.name; break;
+            case SQL_FIELD_TYPE:             field >> c.type; break;
+            case SQL_FIELD_COLL:             field >> c.collation; break;
+            case SQL_FIELD_IS_NULLABLE:      field >> c.is_nullable; break;
+            case SQL_FIELD_IS_AUTOINCREMENT: field >> c.is_autoincrement; break;
+            default:
+                field.skip();
+            }
+        }
+
+        c.kind = type_by_name(c.type);
+        switch (c.kind)
+        {
+        case sql_type::integer:          _decoders.push_back(decode_integer); break;
+        case sql_type::unsigned_integer: _decoders.push_back(decode_value<uint64_t>); break;
+        case sql_type::number:           _decoders.push_back(decode_number); break;
+        case sql_type::string:           _decoders.push_back(decode_value<string_view>); break;
+        case sql_type::boolean:          _decoders.push_back(decode_value<bool>); break;
+        case sql_type::varbinary:        _decoders.push_back(decode_varbinary); break;
+        default:                         _decoders.push_back(decode_any);
+        }
+        _by_name.try_emplace(c.name, static_cast<uint32_t>(_columns.size() - 1));
+    }
+}
+
+sql_column_data sql_metadata::make_column(size_t column, size_t reserve) const
+{
+    sql_column_data res;
+    res.kind = _columns[column].kind;
+    res.nulls.reserve(reserve);
+    auto init = [&res, reserve]<typename T>(vector<T> &&values) {
+        values.reserve(reserve);
+        res.values = std::move(values);
+    };
+    switch (res.kind)
+    {
+    case sql_type::integer:          init(vector<int64_t>{}); break;
+    case sql_type::unsigned_integer: init(vector<uint64_t>{}); break;
+    case sql_type::number:           init(vector<double>{}); break;
+    case sql_type::string:
+    case sql_type::varbinary:        init(vector<string_view>{}); break;
+    case sql_type::boolean:          init(vector<bool>{}); break;
+    default:                         init(vector<mp_plain>{});
+    }
+    return res;
+}
+
+shared_ptr<const sql_metadata> sql_metadata_cache::get(mp_plain metadata)
+{
+    string_view key(metadata.begin, static_cast<size_t>(metadata.end - metadata.begin));
+    {
+        lock_guard<mutex> lk(_guard);
+        if (auto it = _items.find(key); it != _items.end())
+            return it->second;
+    }
+    // parse outside the lock, a concurrent duplicate is harmless
+    auto res = make_shared<const sql_metadata>(metadata);
+    lock_guard<mutex> lk(_guard);
+    return _items.try_emplace(string(key), std::move(res)).first->second;
+}
+
+sql_result::sql_result(mp_plain body, sql_metadata_cache &cache)
+{
+    parse(body, &cache);
+}
+
+sql_result::sql_result(mp_plain body)
+{
+    parse(body, nullptr);
+}
+
+void sql_result::parse(mp_plain body, sql_metadata_cache *cache)
+{
+    auto r = mp_reader(body).read<mp_map_reader>();
+    while (r.has_next())
+    {
+        int key = r.read<int>();
+        const char *begin = r.pos();
+        switch (key)
+        {
+        case response_field::IPROTO_METADATA:
+        {
+            mp_plain metadata{begin, r.skip().pos()};
+            _metadata = cache ? cache->get(metadata) : make_shared<const sql_metadata>(metadata);
+            break;
+        }
+        case response_field::IPROTO_DATA:
+            r.skip();
+            _data = mp_array(begin, r.pos());
+            break;
+        case response_field::IPROTO_SQL_INFO:
+        {
+            auto info = r.read<mp_map_reader>();
+            while (info.has_next())
+            {
+                switch (info.read<int>())
+                {
+                case SQL_INFO_ROW_COUNT:         info >> _row_count; break;
+                case SQL_INFO_AUTOINCREMENT_IDS: info >> _autoincrement_ids; break;
+                default:
+                    info.skip();
+                }
+            }
+            break;
+        }
+        default:
+            r.skip();
+        }
+    }
+}
+
+vector<sql_column_data> sql_result::columns() const
+{
+    vector<sql_column_data> res;
+    if (!_metadata)
+        return res;
+
+    const sql_metadata &md = *_metadata;
+    res.reserve(md.size());
+    for (size_t i = 0; i < md.size(); ++i)
+        res.push_back(md.make_column(i, size()));
+
+    mp_array_reader rows(_data);
+    while (rows.has_next())
+    {
+        auto row = rows.read<mp_array_reader>();
+        if (row.cardinality() != md.size())
+            throw mp_reader_error("row doesn't match metadata", row.content());
+        mp_reader<mp_plain> cells(mp_plain{row.pos(), row.end()});
+        for (size_t i = 0; i < md.size(); ++i)
+            md.decode(i, cells, res[i]);
+    }
+
+    // integer columns mixing negative values with ones above INT64_MAX
+    for (size_t i = 0; i < md.size(); ++i)
+    {
+        if (res[i].kind != sql_type::any || md.columns()[i].kind != sql_type::integer)
+            continue;
+        mp_array_reader again(_data);
+        while (again.has_next())
+        {
+            auto row = again.read<mp_array_reader>();
+            mp_reader<mp_plain> cells(mp_plain{row.pos(), row.end()});
+            for (size_t skip = 0; skip < i; ++skip)
+                cells.skip();
+            decode_any(cells, res[i]);
+        }
+    }
+    return res;
+}
+
+} // namespace tnt
@@ -0,0 +1,228 @@
+#ifndef TNT_SQL_H
+#define TNT_SQL_H
+
+/** @file */
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <variant>
+#include <vector>
+#include "mp_reader.h"
+#include "schema.h"
+
+/// Tarantool connector scope
+namespace tnt
+{
+
+/// Prepared SQL statement (see connection::execute()).
+struct prepared_statement
+{
+    uint64_t id = 0;                ///< server-side statement id, 0 - not prepared
+    uint64_t schema_id = 0;         ///< schema version the statement was prepared at
+    bool preparing = false;         ///< PREPARE request is in flight
+    bool failed = false;            ///< PREPARE failed at schema_id (executed by text until schema change or reconnect)
+    uint32_t bind_count = 0;        ///< number of parameters
+    std::vector<char> metadata;     ///< IPROTO_METADATA (array of column maps), empty for DML
+    std::vector<char> bind_metadata;///< IPROTO_BIND_METADATA
+};
+
+/// Column value representation selected by its SQL type.
+enum class sql_type : uint8_t
+{
+    any,        ///< scalar, decimal, uuid, map and so on (raw messagepack)
+    integer,
+    unsigned_integer,
+    number,     ///< number, double
+    string,
+    boolean,
+    varbinary,
+};
+
+/// SQL result column (IPROTO_METADATA item).
+struct sql_column
+{
+    std::string name;
+    std::string type;               ///< SQL type name as reported by the server
+    sql_type kind = sql_type::any;
+    std::string collation;
+    bool is_nullable = true;
+    bool is_autoincrement = false;
+};
+
+/// Column of SQL result rows decoded at once (see sql_result::columns()).
+struct sql_column_data
+{
+    /** Type of the values, the column type except for integer columns holding values above
+     *  INT64_MAX: unsigned_integer if none of the values is negative, any otherwise. */
+    sql_type kind = sql_type::any;
+    std::vector<bool> nulls;        ///< true - the cell is null (the value is default constructed)
+    std::variant<std::vector<mp_plain>,         // any
+                 std::vector<int64_t>,          // integer
+                 std::vector<uint64_t>,         // unsigned_integer
+                 std::vector<double>,           // number
+                 std::vector<std::string_view>, // string, varbinary
+                 std::vector<bool>              // boolean
+                 > values;
+
+    /// Values of the column, e.g. `col.as<int64_t>()`.
+    template <typename T>
+    const std::vector<T>& as() const
+    {
+        return std::get<std::vector<T>>(values);
+    }
+
+    size_t size() const noexcept
+    {
+        return nulls.size();
+    }
+};
+
+/** Parsed IPROTO_METADATA. Every column gets its decoder selected once by the column type,
+ *  so the rows are decoded without per cell type dispatch and name lookups. */
+class sql_metadata
+{
+public:
+    explicit sql_metadata(mp_plain metadata);
+
+    const std::vector<sql_column>& columns() const noexcept
+    {
+        return _columns;
+    }
+
+    size_t size() const noexcept
+    {
+        return _columns.size();
+    }
+
+    /// 0-based column number by its name.
+    std::optional<size_t> column(std::string_view name) const
+    {
+        auto it = _by_name.find(name);
+        return it == _by_name.end() ? std::nullopt : std::optional<size_t>(it->second);
+    }
+
+    /// Decode the next cell of the row into the column.
+    void decode(size_t column, mp_reader<mp_plain> &row, sql_column_data &dst) const
+    {
+        _decoders[column](row, dst);
+    }
+
+    /// Empty column of the type ready to decode into.
+    sql_column_data make_column(size_t column, size_t reserve = 0) const;
+
+private:
+    using decoder = void (*)(mp_reader<mp_plain> &row, sql_column_data &dst);
+    std::vector<sql_column> _columns;
+    std::vector<decoder> _decoders;
+    name_map _by_name;
+};
+
+/** Thread-safe cache of parsed metadata keyed by IPROTO_METADATA bytes,
+ *  so the metadata of the same statement is parsed once. */
+class sql_metadata_cache
+{
+public:
+    std::shared_ptr<const sql_metadata> get(mp_plain metadata);
+
+    size_t size() const
+    {
+        std::lock_guard<std::mutex> lk(_guard);
+        return _items.size();
+    }
+
+    void clear()
+    {
+        std::lock_guard<std::mutex> lk(_guard);
+        _items.clear();
+    }
+
+private:
+    mutable std::mutex _guard;
+    std::unordered_map<std::string, std::shared_ptr<const sql_metadata>, string_hash, std::equal_to<>> _items;
+};
+
+/** SQL EXECUTE response body reader.
+ *
+ *  \code
+ *  tnt::sql_result res(body, cache);
+ *  auto rows = res.rows<std::tuple<int64_t, std::string>>();  // row by row
+ *  auto cols = res.columns();                                 // or column by column
+ *  for (auto id: cols[0].as<int64_t>()) ...
+ *  \endcode
+ */
+class sql_result
+{
+public:
+    /// Parse metadata through the cache.
+    sql_result(mp_plain body, sql_metadata_cache &cache);
+    /// Parse metadata (if any) for this result only.
+    explicit sql_result(mp_plain body);
+
+    /// DQL result (has metadata and rows).
+    bool has_rows() const noexcept
+    {
+        return _metadata != nullptr;
+    }
+
+    /// Precondition: has_rows().
+    const sql_metadata& metadata() const noexcept
+    {
+        return *_metadata;
+    }
+
+    /// Number of rows (DQL).
+    size_t size() const noexcept
+    {
+        return _data.cardinality;
+    }
+
+    /// IPROTO_DATA array of rows (DQL).
+    mp_array data() const noexcept
+    {
+        return _data;
+    }
+
+    /// Number of changed rows (DML).
+    uint64_t row_count() const noexcept
+    {
+        return _row_count;
+    }
+
+    /// Ids generated by autoincrement fields (DML).
+    const std::vector<int64_t>& autoincrement_ids() const noexcept
+    {
+        return _autoincrement_ids;
+    }
+
+    /// Decode rows into typed values (std::tuple, types with operator>> for mp_reader and so on).
+    template <typename Row>
+    std::vector<Row> rows() const
+    {
+        std::vector<Row> res;
+        res.reserve(size());
+        mp_array_reader rows(_data);
+        while (rows.has_next())
+            rows >> res.emplace_back();
+        return res;
+    }
+
+    /// Decode rows into columns.
+    std::vector<sql_column_data> columns() const;
+
+private:
+    void parse(mp_plain body, sql_metadata_cache *cache);
+
+    std::shared_ptr<const sql_metadata> _metadata;
+    mp_array _data;
+    uint64_t _row_count = 0;
+    std::vector<int64_t> _autoincrement_ids;
+};
+
+} // namespace tnt
+
+#endif // TNT_SQL_H
@@ -145,6 +145,9 @@ bool open_tnt_connection(const std::string &connection_string)
     std::unique_lock lk(m);
     tasks4ev.push([connection_string](tnt::connection &cn){
         cn.set_connection_string(connection_string);
+        // streams and watchers are needed by the transaction and watch tests
+        cn.set_required_proto({{tnt::feature::STREAMS, tnt::feature::TRANSACTIONS, tnt::feature::ERROR_EXTENSION,
+                                tnt::feature::WATCHERS}, 0, "chap-sha1"});
         ev_wrapper.take_care(&cn);
         cn.on_error([&](std::string_view message, tnt::error code, uint32_t db_error)
         {
@@ -188,18 +191,17 @@ bool open_tnt_connection(const std::string &connection_string)
 
         cn.on_response([&](wtf_buffer &buf)
         {
-            mp_reader bunch{buf};
-            while (mp_reader r = bunch.iproto_message())
+            // messages are framed by the connector already
+            for (const tnt::message_info &msg: cn.input_messages())
             {
                 // make a copy to capture it
-                std::vector<char> src_copy(r.begin(), r.end());
-                r = mp_reader(src_copy);
+                std::vector<char> src_copy(buf.data() + msg.offset, buf.data() + msg.offset + msg.size);
+                mp_reader r(src_copy);
 
                 try
                 {
                     auto encoded_header = r.read<mp_map_reader>();
-                    uint64_t sync;
-                    encoded_header[tnt::header_field::SYNC] >> sync;
+                    uint64_t sync = msg.sync;
                     auto handler = loop_side_handlers.extract(sync);
                     if (handler.empty())
                     {
@@ -1,11 +1,21 @@
+#include <atomic>
 #include <map>
 #include <optional>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "batch_decoder.h"
 #include "connection.h"
 #include "ev4cpp2tnt.h"
 #include "iproto.h"
+#include "iproto_error.h"
 #include "mp_reader.h"
+#include "mp_json.h"
 #include "iproto_writer.h"
+#include "schema.h"
+#include "sql.h"
 #include "tests/sync.h"
+#include "transaction.h"
 #include "ut.hpp"
 #include "msgpuck/ext_tnt.h"
 
@@ -25,6 +35,10 @@ operator>> (mp_reader<MP>& r, T &val)
     return r;
 }
 
+/// `T` can be written with mp_writer.
+template <typename T>
+concept mp_writable = requires(mp_writer &w, T &&val) { w << std::forward<T>(val); };
+
 void throw_if_error(const mp_map_reader &header, const mp_map_reader &body)
 {
     int32_t code;
@@ -53,6 +67,137 @@ std::vector<char> hex2bin(string_view hex)
     return res;
 }
 
+/** Tarantool stand-in on a unix socket. Drives a connection without an event loop
+ *  (via connection::read()) to check the connector's own traffic. */
+class fake_tnt
+{
+public:
+    fake_tnt() : path(std::format("/tmp/cpp2tnt_test_{}.sock", getpid()))
+    {
+        ::unlink(path.c_str());
+        listener = socket(AF_UNIX, SOCK_STREAM, 0);
+        sockaddr_un addr{AF_UNIX, {}};
+        std::copy(path.begin(), path.end(), addr.sun_path);
+        if (bind(listener, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) || listen(listener, 1))
+            throw runtime_error("unable to listen " + path);
+    }
+
+    ~fake_tnt()
+    {
+        if (peer >= 0)
+            ::close(peer);
+        ::close(listener);
+        ::unlink(path.c_str());
+    }
+
+    /// Accept the connection, send greeting and answer IPROTO_ID with the features.
+    void handshake(tnt::connection &cn, vector<int> features = {})
+    {
+        cn.set_connection_string("unix/:" + path);
+        cn.open();
+        peer = accept(listener, nullptr, nullptr);
+        string greeting = "Tarantool 3.3.1 (Binary) 00000000-0000-0000-0000-000000000000";
+        greeting.resize(tnt::VERSION_SIZE - 1, ' ');
+        greeting += '\n' + string(tnt::SALT_SIZE, 'A');
+        greeting.resize(tnt::GREETING_SIZE - 1, ' ');
+        greeting += '\n';
+        ::send(peer, greeting.data(), greeting.size(), 0);
+        cn.read();
+
+        auto id = receive();
+        message(0, sync(id), 1, [&features](mp_writer &w) {
+            w.begin_map(2);
+            w << static_cast<int>(tnt::body_field::VERSION) << 6
+              << static_cast<int>(tnt::body_field::FEATURES) << features;
+            w.finalize();
+        });
+        send(cn);
+    }
+
+    /// The next request (header and body), empty if nothing was sent.
+    vector<char> receive()
+    {
+        char prefix[5];
+        if (recv(peer, prefix, sizeof(prefix), MSG_DONTWAIT) != sizeof(prefix))
+            return {};
+        const char *pos = prefix;
+        vector<char> res(mp_decode_uint(&pos));
+        recv(peer, res.data(), res.size(), MSG_WAITALL);
+        return res;
+    }
+
+    static mp_map_reader header(const vector<char> &request)
+    {
+        return mp_reader(request).read<mp_map_reader>();
+    }
+
+    static mp_map_reader body(const vector<char> &request)
+    {
+        mp_reader r(request);
+        r.skip();
+        return r.read<mp_map_reader>();
+    }
+
+    static uint64_t sync(const vector<char> &request)
+    {
+        return header(request)[tnt::header_field::SYNC].read<uint64_t>();
+    }
+
+    static uint32_t code(const vector<char> &request)
+    {
+        return header(request)[tnt::header_field::CODE].read<uint32_t>();
+    }
+
+    /// Put a message into the outgoing batch, `body` must write the body map.
+    template <typename F>
+    void message(uint32_t code, uint64_t sync, uint64_t schema_id, F &&body)
+    {
+        w.start_message();
+        w.begin_map(3);
+        w << static_cast<int>(tnt::header_field::CODE) << code
+          << static_cast<int>(tnt::header_field::SYNC) << sync
+          << static_cast<int>(tnt::header_field::SCHEMA_ID) << schema_id;
+        w.finalize();
+        body(w);
+        w.finalize();
+    }
+
+    /// Body writer of a regular response.
+    template <typename T>
+    static auto data(T value)
+    {
+        return [value](mp_writer &w) {
+            w.begin_map(1);
+            w << static_cast<int>(tnt::response_field::IPROTO_DATA) << value;
+            w.finalize();
+        };
+    }
+
+    /// Body writer of an error response.
+    static auto error(string_view message)
+    {
+        return [message](mp_writer &w) {
+            w.begin_map(1);
+            w << static_cast<int>(tnt::response_field::IPROTO_ERROR_24) << message;
+            w.finalize();
+        };
+    }
+
+    /// Send the outgoing batch at once and let the connection read it.
+    void send(tnt::connection &cn)
+    {
+        ::send(peer, out.data(), out.size(), 0);
+        out.clear();
+        cn.read();
+    }
+
+private:
+    string path;
+    int listener = -1, peer = -1;
+    wtf_buffer out;
+    tnt::iproto_writer w{[] { return uint64_t(0); }, out};
+};
+
 int main(int argc, char *argv[])
 {
     mp_initialize();
@@ -151,6 +296,77 @@ int main(int argc, char *argv[])
         expect(ret_items.read<bool>() == true);
     };
 
+    "mp ext types"_test = [] {
+        // decimal 123.456789012345678901234567890123, uuid, datetime, interval from the "mp_reader" test
+        auto mp = hex2bin("94c712011e123456789012345678901234567890123cd80264d22e4dac924a23899ae59f34af5479d80460c91f610000000015cd5b07b4000000c70b0604000101ccc803d0b30801");
+        mp_decimal dec;
+        mp_uuid uuid;
+        mp_datetime dt;
+        mp_interval itv;
+        mp_reader(mp).read<mp_array_reader>() >> dec >> uuid >> dt >> itv;
+        expect(dec.scale == 30_i && dec.mantissa == static_cast<__int128>(1234567890123456789ll) * 100000000000000ll + 1234567890123ll);
+        expect(dec.to_double() == 123.45678901234568_d) << "epsilon=0.0000000000001";
+        expect(uuid.bytes[0] == 0x64 && uuid.bytes[15] == 0x79);
+        expect(dt == mp_datetime{1629473120, 123456789, 180, 0});
+        expect(itv.year == 1_i && itv.month == 200_i && itv.day == -77_i && itv.adjust == mp_interval::adjust_mode::limit);
+
+        wtf_buffer buf;
+        mp_writer w(buf);
+        w.begin_array(4);
+        w << dec << uuid << dt << itv;
+        w.finalize();
+        expect(vector<char>(buf.data(), buf.end) == mp);
+
+        mp_plain_unchecked_reader(mp).read<mp_array_unchecked_reader>() >> mp_none() >> mp_none() >> dt;
+        expect(dt.epoch == 1629473120_ll);
+
+        // negative, zero and even digit count decimals, datetime without tail
+        buf.clear();
+        w << mp_decimal{-5, 0} << mp_decimal{0, 2} << mp_decimal{1234, -2} << mp_datetime{-1};
+        expect(vector<char>(buf.data(), buf.end) == hex2bin("d501005dd501020cd601fe01234cd704ffffffffffffffff")) << hex_dump(buf.data(), buf.end, nullptr);
+        auto r = mp_reader(buf);
+        expect(r.read<mp_decimal>() == mp_decimal{-5, 0} && r.read<mp_decimal>() == mp_decimal{0, 2} &&
+               r.read<mp_decimal>() == mp_decimal{1234, -2} && r.read<mp_datetime>() == mp_datetime{-1});
+
+        auto not_uuid = hex2bin("d50100");
+        expect(throws<mp_reader_error>([&] { mp_reader(not_uuid).read<mp_uuid>(); }));
+    };
+
+    "error_stack"_test = [] {
+        // MP_ERROR ext from the "mp_reader" test
+        auto ext = hex2bin("c776038100918700ab436c69656e744572726f72020701d9305b737472696e67202272657475726e207265717569726528276d73677061636b27292e656e636f6465287b2e2e2e225d03a474657374040005cd4e210682a46e616d65a7554e4b4e4f574ea66669656c647381a476617231a77061796c6f6164");
+        tnt::error_stack ext_errors(mp_plain{ext});
+        expect(ext_errors.size() == 1_ul);
+        auto e = ext_errors.front();
+        expect(e.type == "ClientError" && e.message == "test" && e.line == 7_u && e.code == 20001_u);
+        expect(mp_reader(e.fields).read<mp_map_reader>()["name"].read<string_view>() == "UNKNOWN");
+
+        // IPROTO_ERROR response field
+        wtf_buffer buf;
+        mp_writer w(buf);
+        w.begin_map(1);
+        w << static_cast<int>(tnt::response_field::IPROTO_ERROR);
+        w.begin_map(1);
+        w << 0;
+        w.begin_array(2);
+        w.begin_map(3);
+        w << static_cast<int>(tnt::MP_ERROR_TYPE) << "ClientError" << static_cast<int>(tnt::MP_ERROR_MESSAGE) << "Duplicate key exists" << static_cast<int>(tnt::MP_ERROR_ERRCODE) << 3;
+        w.finalize();
+        w.begin_map(2);
+        w << static_cast<int>(tnt::MP_ERROR_MESSAGE) << "reason" << static_cast<int>(tnt::MP_ERROR_ERRNO) << 5;
+        w.finalize();
+        w.finalize_all();
+        auto body = mp_reader(buf).read<mp_map_reader>();
+        tnt::error_stack errors(body[tnt::response_field::IPROTO_ERROR]);
+        expect(errors.size() == 2_ul && errors.code() == tnt::db_error::TUPLE_FOUND && errors.front().is(tnt::db_error::TUPLE_FOUND));
+        size_t n = 0;
+        for (const auto &item: errors)
+            n += item.message.size();
+        expect(n == 26_ul);
+        expect(errors.to_string() == "Duplicate key exists <- reason");
+        expect(tnt::error_stack().empty() && tnt::error_stack().code() == tnt::db_error::UNKNOWN);
+    };
+
     "mp_array_reader"_test = [] {
         auto mp = hex2bin("0102030405");
         auto r = mp_array_reader(mp.data(), 5);
@@ -161,6 +377,921 @@ int main(int argc, char *argv[])
         expect(r.read_or<int>(1) == 1);
     };
 
+    "mp_unchecked_reader"_test = [] {
+        // [1, -2, "abc", nil, [1.5, true], {"a": 5}]
+        auto mp = hex2bin("9601fea3616263c092cb3ff8000000000000c381a16105");
+        expect(ut::nothrow([&mp] { mp_reader(mp).check(); }));
+        mp_plain_unchecked_reader r(mp);
+        auto items = r.read<mp_array_unchecked_reader>();
+        expect(items.cardinality() == 6_ul);
+        int a;
+        long b;
+        string c;
+        optional<string_view> d;
+        tuple<double, bool> e;
+        items >> a >> b >> c >> d >> e;
+        expect(a == 1_i && b == -2_l && c == "abc" && !d.has_value());
+        expect(e == tuple<double, bool>{1.5, true});
+        auto m = items.read<mp_map_unchecked_reader>();
+        expect(m.find("a").read<int>() == 5_i);
+        expect(!m.find("b"));
+        expect(!items.has_next() && !r.has_next());
+    };
+
+    "mp_reader::try_read"_test = [] {
+        // [300, "abc", nil, -1]
+        auto mp = hex2bin("94cd012ca3616263c0ff");
+        mp_reader r(mp);
+        auto items = r.try_read<mp_array_reader>();
+        expect(bool(items) >> fatal);
+        uint8_t small = 7;
+        auto status = items->try_read(small);
+        expect(status.code == mp_errc::overflow && small == 7_u); // untouched on failure
+        expect(items->try_read<string_view>().status.code == mp_errc::type_mismatch);
+        expect(items->try_read<int>().value == 300_i); // position is kept on failure
+        expect(items->try_read<string>().value == "abc");
+        optional<int> opt = 1;
+        expect(bool(items->try_read(opt)) && !opt.has_value());
+        auto neg = items->try_read<unsigned>();
+        expect(neg.status.code == mp_errc::overflow);
+        expect(neg.status.message().starts_with("value overflow"));
+        expect(items->try_read<int>().value == -1_i);
+        expect(items->try_read<int>().status.code == mp_errc::out_of_bounds);
+        expect(throws<mp_reader_error>([&] { items->try_read<int>().status.throw_if_error(); }));
+        mp_read_status no_memory;
+        no_memory.code = mp_errc::no_memory;
+        expect(throws<std::bad_alloc>([&] { no_memory.throw_if_error(); }));
+
+        auto int8 = hex2bin("d005"); // 5 encoded as MP_INT
+        expect(mp_reader(int8).try_read<unsigned>().value == 5_u);
+    };
+
+    "mp_reader::project"_test = [] {
+        // [10, "x", [1, 2], 13, {"a": 1, "b": "bb", "c": 3}]
+        auto mp = hex2bin("950aa1789201020d83a16101a162a26262a16303");
+        auto items = mp_reader(mp).read<mp_array_reader>();
+        int a = 0, d = 0;
+        optional<int> tail = 1;
+        items.project(mp_at(3, d), mp_at(0, a), mp_at(7, tail));
+        expect(a == 10_i && d == 13_i && !tail.has_value());
+
+        items.rewind();
+        mp_map_reader m;
+        items.project(mp_at(4, m)); // position is right after the map now
+        expect(m.cardinality() == 3_ul && !items.has_next());
+
+        auto map = mp_reader(mp).read<mp_array_reader>()[4].read<mp_map_reader>();
+        string_view b;
+        int c = 0;
+        optional<int> z = 1;
+        map.project(mp_at("c", c), mp_at("b", b), mp_at("z", z));
+        expect(b == "bb" && c == 3_i && !z.has_value());
+        map.rewind();
+        expect(throws<mp_reader_error>([&] { map.project(mp_at("z", c)); }));
+        map.rewind();
+        auto at_c = mp_at(string("c"), c); // built up front, the key temporary is gone
+        c = 0;
+        map.project(at_c);
+        expect(c == 3_i);
+
+        items.rewind();
+        std::vector<size_t> indexes{1, 3};
+        std::vector<std::string> got;
+        expect(items.project(std::span<const size_t>(indexes), [&got](size_t i, mp_array_reader &r) {
+            got.push_back(std::to_string(i) + ":" + r.to_string());
+        }) == 2_ul);
+        expect(got == std::vector<std::string>{"0:\"x\"", "1:13"}); // positions within `indexes`
+    };
+
+    "mp_key"_test = [] {
+        // {"a": 1, 300: "x", -5: 2, "a": 3}
+        auto mp = hex2bin("84a161"  "01"  "cd012c" "a178"  "fb" "02"  "a161" "03");
+        mp_map map(mp.data(), mp.data() + mp.size());
+        expect(mp_reader(map.find(mp_key("a"))).read<int>() == 1_i);
+        expect(mp_reader(map[mp_key(300)]).read<string_view>() == "x");
+        expect(!map.find(mp_key("b")) && !map.find(mp_key(-6)));
+        expect(mp_reader(mp).read<mp_map_reader>().find(mp_key(-5)).read<int>() == 2_i);
+
+        mp_indexed_map idx(map);
+        expect(mp_reader(idx[mp_key(-5)]).read<int>() == 2_i);
+        expect(mp_reader(idx["a"]).read<int>() == 1_i); // the first one wins
+        expect(mp_reader(idx[300]).read<string_view>() == "x");
+        expect(!idx.find(mp_key(301)));
+        expect(throws<mp_reader_error>([&] { idx["z"]; }));
+    };
+
+    "mp_map_shape"_test = [] {
+        mp_map_shape shape("c", "a", "z");
+        int a = 0, c = 0;
+        optional<int> z = 1;
+        // {"a": 1, "b": "bb", "c": 3, "d": 4}
+        auto m1 = hex2bin("84a16101a162a26262a16303a16404");
+        auto r = mp_reader(m1).read<mp_map_reader>();
+        r.project(shape, c, a, z);
+        expect(a == 1_i && c == 3_i && !z && shape.misses() == 1_ul && !r.has_next());
+
+        // the same shape, other values: {"a": 10, "b": "bbb", "c": 30, "d": 4}
+        auto m2 = hex2bin("84a1610aa162a3626262a1631ea16404");
+        r = mp_reader(m2).read<mp_map_reader>();
+        r.project(shape, c, a, z);
+        expect(a == 10_i && c == 30_i && shape.misses() == 1_ul);
+
+        // shape changed: {"c": 5, "z": 6, "a": 7, "d": 4}
+        auto m3 = hex2bin("84a16305a17a06a16107a16404");
+        r = mp_reader(m3).read<mp_map_reader>();
+        r.project(shape, c, a, z);
+        expect(a == 7_i && c == 5_i && z == 6 && shape.misses() == 2_ul);
+        expect(r.has_next()); // "d" is not examined
+
+        // {"c": 5, "d": 4} - required "a" is absent
+        auto m4 = hex2bin("82a16305a16404");
+        r = mp_reader(m4).read<mp_map_reader>();
+        expect(throws<mp_reader_error>([&] { r.project(shape, c, a, z); }));
+    };
+
+    "mp_reader pmr"_test = [] {
+        // [["a long string, longer than sso buffer", "x"], {1: "a long string, longer than sso buffer"}, "a long string, longer than sso buffer"]
+        auto mp = hex2bin("9392d92561206c6f6e6720737472696e672c206c6f6e676572207468616e2073736f20627566666572a17881"
+                          "01d92561206c6f6e6720737472696e672c206c6f6e676572207468616e2073736f20627566666572"
+                          "d92561206c6f6e6720737472696e672c206c6f6e676572207468616e2073736f20627566666572");
+        // no fallback to the global heap
+        char arena[4096];
+        pmr::monotonic_buffer_resource mr(arena, sizeof(arena), pmr::null_memory_resource());
+        pmr::vector<pmr::string> v(&mr);
+        pmr::map<int, pmr::string> m(&mr);
+        optional<pmr::string> s{pmr::string(&mr)};
+        expect(ut::nothrow([&] { mp_reader(mp).read<mp_array_reader>() >> v >> m >> s; }));
+        expect(v.size() == 2_ul && v[1] == "x" && m[1] == v[0] && s == v[0]);
+        expect(s->get_allocator().resource() == &mr);
+    };
+
+    "mp_tuple_view"_test = [] {
+        mp_tuple_view<int, string_view, optional<int>> t;
+        mp_string_view s;
+        {
+            // [[1, "abc", nil], "xyz"]
+            auto batch = make_shared<std::vector<char>>(hex2bin("9293" "01" "a3616263" "c0" "a378797a"));
+            auto r = mp_reader(*batch).read<mp_array_reader>();
+            t = decltype(t){batch};
+            s = mp_string_view{batch};
+            r >> t >> s;
+        }
+        expect(t.owner().use_count() == 2_l);
+        expect(t.get<0>() == 1_i && t.get<1>() == "abc" && !t.get<2>());
+        expect(s == "xyz");
+        expect(mp_reader(t.raw()).to_string() == R"([1, "abc", null])");
+    };
+
+    "mp_reader numeric vector"_test = [] {
+        // [1, 2, 200, 300, 70000, -1, -100, 5000000000]
+        auto mp = hex2bin("98" "01" "02" "ccc8" "cd012c" "ce00011170" "ff" "d09c" "cf000000012a05f200");
+        vector<int64_t> i64;
+        mp_reader(mp) >> i64;
+        expect(i64 == vector<int64_t>{1, 2, 200, 300, 70000, -1, -100, 5000000000});
+        vector<int> i32;
+        expect(throws<mp_reader_error>([&] { mp_reader(mp) >> i32; }));
+        vector<uint64_t> u64;
+        expect(throws<mp_reader_error>([&] { mp_reader(mp) >> u64; }));
+
+        // non-negative MP_INT fits unsigned types either way: [5 (int 8), -1]
+        auto mixed = hex2bin("92" "d005" "ff");
+        vector<unsigned> u32;
+        mp_reader(hex2bin("91d005")) >> u32;
+        expect(u32 == vector<unsigned>{5});
+        mp_array_reader items = mp_reader(mixed).read<mp_array_reader>();
+        expect(items.read<unsigned>() == 5_u);
+        expect(throws<mp_reader_error>([&] { items.read<unsigned>(); }));
+        expect(throws<mp_reader_error>([&] { mp_reader(mixed) >> u32; }));
+
+        // [1.5f, 2.5f, 0.25, nan, 1e300]
+        auto fp = hex2bin("95" "ca3fc00000" "ca40200000" "cb3fd0000000000000" "cb7ff8000000000000" "cb7e37e43c8800759c");
+        vector<double> d;
+        mp_reader(fp) >> d;
+        expect(d.size() == 5_ul && d[0] == 1.5_d && d[1] == 2.5_d && d[2] == 0.25_d && std::isnan(d[3]) && d[4] == 1e300);
+        vector<float> f;
+        expect(throws<mp_reader_error>([&] { mp_reader(fp) >> f; }));
+
+        vector<int> big(100000);
+        for (size_t i = 0; i < big.size(); ++i)
+            big[i] = static_cast<int>(i * 37) - 1000000;
+        wtf_buffer buf;
+        mp_writer(buf) << big;
+        vector<int> decoded;
+        mp_reader(buf) >> decoded;
+        expect(decoded == big);
+    };
+
+    "mp_writer numeric span"_test = [] {
+        wtf_buffer buf(64);
+        mp_writer w(buf);
+        auto hex = [&buf] { return hex_dump(buf.data(), buf.end, nullptr); };
+        auto same = [&buf](string_view expected) {
+            auto bin = hex2bin(expected);
+            return buf.size() == bin.size() && std::equal(bin.begin(), bin.end(), buf.data());
+        };
+
+        w.begin_array(2);
+        w << vector<uint16_t>{1, 2, 127} << vector<int>{1, 300};
+        w.finalize();
+        expect(same("92" "9301027f" "92cd0001cd012c")) << hex();
+
+        buf.clear();
+        w << vector<long>{5, -1, -200} << std::span<const double>() << vector<float>{1.5f};
+        expect(same("9305ffd1ff38" "90" "91ca3fc00000")) << hex();
+
+        buf.clear();
+        vector<uint64_t> u{1, 5000000000};
+        w << std::span(u) << vector<double>{0.0, -2.5};
+        expect(same("92cf0000000000000001cf000000012a05f200" "92cb0000000000000000cbc004000000000000")) << hex();
+
+        buf.clear();
+        int fixed[3] = {1, 2, 3};
+        w << std::span<const int, 3>(fixed) << std::span(fixed);
+        expect(same("93010203" "93010203")) << hex();
+    };
+
+    "mp_writer ranges"_test = [] {
+        wtf_buffer buf(64);
+        mp_writer w(buf);
+        vector<int> src{1, 2, 3, 4, 5, 6};
+        vector<string> names{"a", "bb"};
+        w.begin_array(4);
+        w << (src | views::filter([](int i) { return i % 2 == 0; }))       // unknown size
+          << (src | views::transform([](int i) { return i * 100; }) | views::take(2))
+          << std::array<string_view, 1>{"x"}
+          << views::all(names);
+        w.finalize();
+        expect(mp_reader(buf).to_string() == R"([[2, 4, 6], [100, 200], ["x"], ["a", "bb"]])");
+
+        // readers are not ranges of items: only a mutable one is written (its next item)
+        static_assert(mp_writable<mp_reader<mp_plain>&> && !mp_writable<const mp_reader<mp_plain>&>);
+        static_assert(!mp_writable<mp_reader<mp_plain>> && !mp_writable<const mp_unchecked_reader<mp_plain>&>);
+        wtf_buffer packed(16), copy(16);
+        mp_writer(packed) << vector{1, 2};
+        mp_reader r(packed);
+        mp_writer(copy) << r;
+        expect(mp_reader(copy).to_string() == "[1, 2]");
+    };
+
+    "mp_writer::finalize"_test = [] {
+        wtf_buffer buf(256);
+        mp_writer w(buf);
+        w.begin_array(70000);   // 5-byte header reserved
+        w.begin_map(1);         // 1-byte header reserved
+        for (int i = 0; i < 20; ++i)
+            w << i << i;
+        w.finalize();
+        w << "x";
+        w.finalize();
+        auto r = mp_reader(buf);
+        expect(buf.data()[0] == '\x92' && buf.data()[1] == '\xde') << hex_dump(buf.data(), buf.end, nullptr);
+        auto items = r.read<mp_array_reader>();
+        expect(items.cardinality() == 2_ul);
+        expect(items.read<map<int, int>>().size() == 20_ul && items.read<string_view>() == "x");
+        expect(buf.size() == 1 + 3 + 20 * 2 + 2);
+    };
+
+    "mp_writer deep nesting"_test = [] {
+        constexpr int depth = 100;
+        wtf_buffer buf;
+        mp_writer w(buf);
+        for (int i = 0; i < depth / 2; ++i)
+            w.begin_array(1);
+        auto state = w.get_state();
+        w << 1;
+        for (int i = 0; i < depth / 2; ++i)
+            w.begin_array(1);
+        w.set_state(state); // undo the deeper half
+        for (int i = 0; i < depth / 2; ++i)
+            w.begin_array(2);
+        w << 2;
+        for (int i = 0; i < depth; ++i)
+            w.finalize();
+        expect(throws([&w] { w.finalize(); }));
+
+        auto r = mp_reader(buf);
+        expect(ut::nothrow([&r] { r.check(); }));
+        auto level = r.read<mp_array_reader>();
+        for (int i = 1; i < depth; ++i)
+            level = level.read<mp_array_reader>();
+        expect(level.cardinality() == 1_ul && level.read<int>() == 2);
+    };
+
+    "mp_json_writer"_test = [] {
+        // [1, -2, "a\"b\n", nil, true, 1.5, {"k": [], 7: {}}, bin(01 02 03), bin(01 02)]
+        auto mp = hex2bin("9901fea46122620ac0c3cb3ff800000000000082a16b900780c403010203c4020102");
+        wtf_buffer buf;
+        mp_json_writer(buf) << mp_plain(mp);
+        expect(string_view(buf.data(), buf.size()) == R"([1,-2,"a\"b\n",null,true,1.5,{"k":[],"7":{}},"AQID","AQI="])");
+
+        auto bad_key = hex2bin("819001"); // {[]: 1}
+        expect(throws<mp_reader_error>([&] { mp_json_writer(buf) << mp_plain(bad_key); }));
+
+        // long string is transcoded in chunks
+        string str(10000, 'x');
+        string expected = "[\"";
+        for (size_t i = 0; i < str.size(); i += 7)
+            str[i] = '\t';
+        for (char c : str)
+            expected += c == '\t' ? "\\t" : string(1, c);
+        expected += "\",2]";
+        wtf_buffer src;
+        mp_writer w(src);
+        w.begin_array(2);
+        w << str << 2;
+        w.finalize();
+        string out;
+        size_t chunks = 0;
+        wtf_buffer chunk_buf(256);
+        mp_json_writer jw(chunk_buf, 1024, [&](wtf_buffer &chunk) {
+            out.append(chunk.data(), chunk.size());
+            chunk.clear();
+            ++chunks;
+        });
+        mp_reader r(src);
+        jw << r;
+        jw.flush();
+        expect(out == expected);
+        expect(chunks > 1_ul && chunk_buf.capacity() < 64 * 1024);
+    };
+
+    "mp_json"_test = [] {
+        auto to_json = [](const wtf_buffer &mp) {
+            wtf_buffer buf;
+            mp_json_writer(buf) << mp_plain(mp);
+            return string(buf.data(), buf.size());
+        };
+        wtf_buffer mp;
+        mp_writer w(mp);
+        w << mp_json{R"( {"a": [1, -2, 3.5, true, false, null, {}, []], "s": "q\"\u00e9\ud83d\ude00\/x",
+                        "big": 18446744073709551615, "neg": -9223372036854775809, "e": 1e3} )"};
+        expect(to_json(mp) == R"({"a":[1,-2,3.5,true,false,null,{},[]],"s":"q\"é😀/x","big":18446744073709551615,"neg":-9223372036854775808,"e":1000})");
+
+        // long containers get wider headers
+        string json = "[";
+        for (int i = 0; i < 100; ++i)
+            json += (i ? ",\"" : "\"") + string(40, 'a' + i % 26) + "\"";
+        json += "]";
+        mp.clear();
+        w << mp_json{json};
+        expect(mp_reader(mp).read<vector<string>>().size() == 100_ul);
+        expect(to_json(mp) == json);
+
+        // malformed json leaves the writer untouched
+        mp.clear();
+        w.begin_array(2);
+        w << 1;
+        auto size = mp.size();
+        for (auto bad : {"[1, 2", "{\"a\" 1}", "[1] 2", "\"\\x\"", "tru", "-", "{1: 2}"})
+            expect(throws<runtime_error>([&] { w << mp_json{bad}; })) << bad;
+        expect(mp.size() == size);
+        w << mp_json{"\"ok\""};
+        w.finalize();
+        expect(to_json(mp) == R"([1,"ok"])");
+
+        wtf_buffer req;
+        uint64_t sync = 0;
+        tnt::iproto_writer iw([&sync] { return ++sync; }, req);
+        iw.call("ingest", mp_json{R"({"id": 1})"}, 2);
+        auto msg = mp_reader(req).iproto_message();
+        msg >> mp_none();
+        auto args = msg.read<mp_map_reader>()[tnt::body_field::TUPLE].read<mp_array_reader>();
+        expect(args.cardinality() == 2_ul && args.read<mp_map_reader>()["id"].read<int>() == 1);
+    };
+
+    "batch_decoder"_test = [] {
+        auto batch = make_shared<wtf_buffer>();
+        uint64_t sync = 0;
+        tnt::iproto_writer w([&sync] { return ++sync; }, *batch);
+        for (int i = 0; i < 1000; ++i)
+            w.call("fn", i);
+        vector<tnt::message_info> messages;
+        mp_reader bunch(*batch);
+        while (mp_reader msg = bunch.iproto_message())
+        {
+            tnt::message_info info{static_cast<size_t>(msg.begin() - batch->data()), msg.size()};
+            msg.read<mp_map_reader>()[tnt::header_field::SYNC] >> info.sync;
+            messages.push_back(info);
+        }
+        expect(messages.size() == 1000_ul);
+
+        tnt::batch_decoder decoder(4);
+        mutex m;
+        condition_variable cv;
+        bool done = false;
+        exception_ptr error;
+        atomic<int64_t> sum{0};
+        long batch_refs = 0;
+        auto wait = [&] {
+            unique_lock lk(m);
+            cv.wait(lk, [&] { return done; });
+            done = false;
+        };
+        auto on_complete = [&](exception_ptr e) {
+            lock_guard lk(m);
+            error = e;
+            batch_refs = batch.use_count();
+            done = true;
+            cv.notify_one();
+        };
+
+        decoder.process(batch, messages, [&sum](const tnt::message_info &info, mp_plain message) {
+            mp_reader r(message);
+            r >> mp_none();
+            auto args = r.read<mp_map_reader>()[tnt::body_field::TUPLE].read<mp_array_reader>();
+            sum += args.read<int>() + static_cast<int64_t>(info.sync);
+        }, on_complete);
+        wait();
+        expect(!error && sum == 999 * 1000 / 2 + 1000 * 1001 / 2);
+        expect(batch_refs == 1_l); // released before completion
+
+        decoder.process(batch, messages, [](const tnt::message_info &info, mp_plain) {
+            if (info.sync == 500)
+                throw runtime_error("bad message");
+        }, on_complete);
+        wait();
+        expect(throws<runtime_error>([&] { rethrow_exception(error); }));
+    };
+
+    "iproto_writer growth"_test = [] {
+        wtf_buffer buf(16);
+        uint64_t sync = 0;
+        tnt::iproto_writer w([&sync] { return ++sync; }, buf);
+        string arg(5000, 'x');
+        w.call("fn", arg, vector<int>(1000, 100000), 1.5);
+        expect(buf.capacity() >= buf.size());
+        auto msg = mp_reader(buf).iproto_message();
+        msg >> mp_none(); // header
+        auto args = msg.read<mp_map_reader>()[tnt::body_field::TUPLE].read<mp_array_reader>();
+        expect(args.read<string_view>() == arg && args.read<vector<int>>().size() == 1000_ul && args.read<double>() == 1.5_d);
+
+        mp_stack_writer<8> sw;
+        expect(throws([&] { sw << string(8, 'x'); })); // raw buffer can't grow
+    };
+
+    "static_call"_test = [] {
+        static_assert(mp_static_cardinality<1, mp_array_header{2}, mp_map_header{1}, 2, 3, 4, "x"_fs>() == 3);
+        static_assert(mp_static_bytes<-33, 300, "ab"_fs, true, nullptr, mp_array_header{16}>.size() == 2 + 3 + 3 + 1 + 1 + 3);
+
+        wtf_buffer b1, b2;
+        uint64_t s1 = 100, s2 = 100;
+        tnt::iproto_writer w1([&s1] { return ++s1; }, b1), w2([&s2] { return ++s2; }, b2);
+        w1.call("box.space.test:replace", 1, -100000, "const", string(40, 'c'), 2.5, nullptr, "runtime");
+        w2.static_call<"box.space.test:replace", 1, -100000, "const"_fs,
+                       mp_fixed_string("cccccccccccccccccccccccccccccccccccccccc"), 2.5>(nullptr, "runtime");
+        expect(b1.size() == b2.size() && std::equal(b1.data(), b1.end, b2.data())) << hex_dump(b2.data(), b2.end, nullptr);
+
+        b1.clear();
+        b2.clear();
+        w1.eval("return ...", 1, "a");
+        w2.static_eval<"return ...">(1, "a");
+        expect(b1.size() == b2.size() && std::equal(b1.data(), b1.end, b2.data())) << hex_dump(b2.data(), b2.end, nullptr);
+
+        // nested constant containers are single items of the tuple
+        b1.clear();
+        b2.clear();
+        w1.call("f", vector<int>{1, 2}, map<string, int>{{"a", 3}}, 7);
+        w2.static_call<"f", mp_array_header{2}, 1, 2, mp_map_header{1}, "a"_fs, 3>(7);
+        expect(b1.size() == b2.size() && std::equal(b1.data(), b1.end, b2.data())) << hex_dump(b2.data(), b2.end, nullptr);
+        mp_reader r(b2);
+        auto msg = r.iproto_message();
+        msg.skip(); // header
+        auto args = msg.read<mp_map_reader>()[tnt::body_field::TUPLE];
+        expect(args.to_string() == R"([[1, 2], {"a": 3}, 7])");
+
+        b2.clear();
+        mp_writer(b2) << mp_static<mp_array_header{2}, 1, "x"_fs>;
+        expect(mp_reader(b2).to_string() == R"([1, "x"])");
+    };
+
+    "schema"_test = [] {
+        wtf_buffer vspace, vindex;
+        {
+            mp_writer w(vspace);
+            w.begin_array(2);
+            w << make_tuple(512, 1, "users", "memtx", 0, map<string, int>{},
+                            make_tuple(map<string, string>{{"name", "id"}, {"type", "unsigned"}},
+                                       map<string, string>{{"name", "login"}, {"type", "string"}}));
+            w << make_tuple(513, 1, "log", "vinyl", 0, map<string, int>{}, vector<int>{});
+            w.finalize();
+            mp_writer wi(vindex);
+            wi.begin_array(3);
+            wi << make_tuple(512, 0, "primary", "tree") << make_tuple(512, 1, "login", "hash")
+               << make_tuple(513, 0, "pk", "tree");
+            wi.finalize();
+        }
+
+        tnt::schema sc;
+        expect(sc.empty() && sc.version() == 0_ul && !sc.space_id("users"));
+        sc.load(mp_plain(vspace), mp_plain(vindex), 80);
+        expect(sc.version() == 80_ul);
+        expect(sc.space_id("users") == 512u && sc.space_id("log") == 513u && !sc.space_id("nope"));
+        expect(sc.index_id("users", "login") == 1u && sc.index_id("log", "pk") == 0u && !sc.index_id("log", "login"));
+        expect(sc.field_no("users", "login") == 1u && !sc.field_no("log", "id"));
+        expect(sc.space(513u)->engine == "vinyl");
+
+        wtf_buffer b1, b2;
+        uint64_t s1 = 0, s2 = 0;
+        tnt::iproto_writer w1([&s1] { return ++s1; }, b1), w2([&s2] { return ++s2; }, b2);
+        w1.encode_select_request(512, 1, make_tuple("bob"), 10);
+        w2.encode_select_request(sc, "users", "login", make_tuple("bob"), 10);
+        expect(b1.size() == b2.size() && std::equal(b1.data(), b1.end, b2.data())) << hex_dump(b2.data(), b2.end, nullptr);
+        expect(throws([&] { w2.encode_select_request(sc, "users", "nope", make_tuple("bob")); }));
+    };
+
+    "connection schema cache"_test = [] {
+        fake_tnt srv;
+        tnt::connection cn;
+        vector<char> batch;
+        vector<tnt::message_info> messages;
+        vector<string> errors;
+        int loaded = 0;
+        cn.on_response([&](wtf_buffer &buf) {
+            batch.assign(buf.data(), buf.end);
+            auto m = cn.input_messages();
+            messages.assign(m.begin(), m.end());
+        });
+        cn.on_error([&](string_view message, tnt::error, uint32_t) { errors.emplace_back(message); });
+        cn.on_schema_loaded([&] { ++loaded; });
+        cn.set_schema_caching(true);
+        srv.handshake(cn);
+
+        // catalog requests sent by the connector: {_vspace sync, _vindex sync}
+        auto catalog_requests = [&srv] {
+            auto vspace = srv.receive(), vindex = srv.receive();
+            expect(fatal(!vspace.empty() && !vindex.empty()));
+            expect(fake_tnt::body(vspace)[tnt::body_field::SPACE].read<uint32_t>() == tnt::VSPACE_ID);
+            expect(fake_tnt::body(vindex)[tnt::body_field::SPACE].read<uint32_t>() == tnt::VINDEX_ID);
+            return pair{fake_tnt::sync(vspace), fake_tnt::sync(vindex)};
+        };
+        auto space = [](int id, string_view name) {
+            return make_tuple(make_tuple(id, 1, name, "memtx", 0, map<string, int>{}, vector<int>{}));
+        };
+        auto index = [](int space_id, string_view name) {
+            return make_tuple(make_tuple(space_id, 0, name, "tree"));
+        };
+
+        // catalog responses interleaved with the caller's ones within a single batch
+        auto [vspace, vindex] = catalog_requests();
+        srv.message(0, 100, 1, fake_tnt::data(make_tuple(100)));
+        srv.message(0, vspace, 1, fake_tnt::data(space(512, "users")));
+        srv.message(0, 101, 1, fake_tnt::data(make_tuple(101)));
+        srv.message(0, vindex, 1, fake_tnt::data(index(512, "primary")));
+        srv.message(0, 102, 1, fake_tnt::data(make_tuple(102)));
+        srv.send(cn);
+
+        expect(fatal(messages.size() == 3_ul));
+        size_t offset = 5;
+        for (size_t i = 0; i < messages.size(); ++i)
+        {
+            const auto &info = messages[i];
+            expect(info.offset == offset && info.sync == 100 + i);
+            auto msg = mp_reader(mp_plain{batch.data() + info.offset, batch.data() + info.offset + info.size});
+            expect(msg.read<mp_map_reader>()[tnt::header_field::SYNC].read<uint64_t>() == 100 + i);
+            expect(msg.read<mp_map_reader>()[tnt::response_field::IPROTO_DATA].to_string() == "[" + to_string(100 + i) + "]");
+            offset = info.offset + info.size + 5;
+        }
+        expect(offset - 5 == batch.size());
+        cn.input_processed();
+        expect(loaded == 1_i && cn.schema().version() == 1_ul);
+        expect(cn.schema().space_id("users") == 512u && cn.schema().index_id("users", "primary") == 0u);
+
+        // reload on schema change
+        srv.message(0, 103, 2, fake_tnt::data(make_tuple(103)));
+        srv.send(cn);
+        cn.input_processed();
+        tie(vspace, vindex) = catalog_requests();
+        srv.message(0, vspace, 2, fake_tnt::data(space(513, "clients")));
+        srv.message(0, vindex, 2, fake_tnt::data(index(513, "pk")));
+        srv.send(cn);
+        expect(loaded == 2_i && cn.schema().version() == 2_ul);
+        expect(cn.schema().space_id("clients") == 513u && !cn.schema().space_id("users"));
+
+        // a failed load is not retried until the schema changes again
+        srv.message(0, 104, 3, fake_tnt::data(make_tuple(104)));
+        srv.send(cn);
+        cn.input_processed();
+        tie(vspace, vindex) = catalog_requests();
+        srv.message(0x8000 | 42, vspace, 3, fake_tnt::error("Read access denied"));
+        srv.message(0, vindex, 3, fake_tnt::data(index(513, "pk")));
+        srv.message(0, 105, 3, fake_tnt::data(make_tuple(105)));
+        srv.send(cn);
+        cn.input_processed();
+        expect(errors.size() == 1_ul && errors[0].find("Read access denied") != string::npos);
+        expect(loaded == 2_i && cn.schema().version() == 2_ul);
+        srv.message(0, 106, 3, fake_tnt::data(make_tuple(106)));
+        srv.send(cn);
+        cn.input_processed();
+        expect(srv.receive().empty());
+        srv.message(0, 107, 4, fake_tnt::data(make_tuple(107)));
+        srv.send(cn);
+        cn.input_processed();
+        catalog_requests();
+    };
+
+    "connection statement cache"_test = [] {
+        fake_tnt srv;
+        tnt::connection cn;
+        srv.handshake(cn);
+        auto type = [](const vector<char> &request) { return static_cast<tnt::request_type>(fake_tnt::code(request)); };
+        auto ok = [](mp_writer &w) { w << map<int, int>{}; };
+
+        // the first use: PREPARE along with EXECUTE by text
+        const string sql = "SELECT ?";
+        cn.execute(sql, 1);
+        cn.flush();
+        auto prepare = srv.receive(), execute = srv.receive();
+        expect(fatal(type(prepare) == tnt::request_type::PREPARE && type(execute) == tnt::request_type::EXECUTE));
+        expect(fake_tnt::body(execute)[tnt::body_field::SQL_TEXT].read<string_view>() == sql);
+        srv.message(0, fake_tnt::sync(prepare), 1, [](mp_writer &w) {
+            w.begin_map(2);
+            w << static_cast<int>(tnt::body_field::STMT_ID) << 7
+              << static_cast<int>(tnt::response_field::IPROTO_BIND_COUNT) << 1;
+            w.finalize();
+        });
+        srv.message(0, fake_tnt::sync(execute), 1, ok);
+        srv.send(cn);
+        cn.input_processed();
+        expect(fatal(cn.statement(sql) != nullptr) && cn.statement(sql)->id == 7_ul && cn.statement(sql)->bind_count == 1_u);
+
+        // then by id only
+        cn.execute(sql, 2);
+        cn.flush();
+        execute = srv.receive();
+        expect(type(execute) == tnt::request_type::EXECUTE && fake_tnt::body(execute)[tnt::body_field::STMT_ID].read<int>() == 7_i);
+        expect(srv.receive().empty());
+        srv.message(0, fake_tnt::sync(execute), 1, ok);
+        srv.send(cn);
+        cn.input_processed();
+
+        // a failed PREPARE is not repeated while the schema stays the same
+        const string bad = "SELECT * FROM nowhere";
+        cn.execute(bad);
+        cn.flush();
+        prepare = srv.receive(), execute = srv.receive();
+        srv.message(0x8000 | 36, fake_tnt::sync(prepare), 1, fake_tnt::error("Space 'NOWHERE' does not exist"));
+        srv.message(0x8000 | 36, fake_tnt::sync(execute), 1, fake_tnt::error("Space 'NOWHERE' does not exist"));
+        srv.send(cn);
+        cn.input_processed();
+        cn.execute(bad);
+        cn.flush();
+        execute = srv.receive();
+        expect(type(execute) == tnt::request_type::EXECUTE && srv.receive().empty());
+        srv.message(0, fake_tnt::sync(execute), 2, ok); // the table is created meanwhile
+        srv.send(cn);
+        cn.input_processed();
+        cn.execute(bad);
+        cn.flush();
+        expect(type(srv.receive()) == tnt::request_type::PREPARE);
+        srv.receive();
+
+        // eviction deallocates the statement
+        cn.set_statement_cache_size(1);
+        cn.flush();
+        expect(!cn.statement(sql));
+        auto unprepare = srv.receive();
+        expect(type(unprepare) == tnt::request_type::PREPARE);
+        expect(fake_tnt::body(unprepare)[tnt::body_field::STMT_ID].read<int>() == 7_i);
+    };
+
+    "connection transaction"_test = [] {
+        fake_tnt srv;
+        tnt::connection cn;
+        srv.handshake(cn, {0, 1});
+        auto type = [](const vector<char> &request) { return static_cast<tnt::request_type>(fake_tnt::code(request)); };
+        auto stream = [](const vector<char> &request) {
+            return fake_tnt::header(request)[tnt::header_field::STREAM_ID].read<uint64_t>();
+        };
+
+        // BEGIN, the operations and COMMIT go with a single flush
+        uint64_t stream_id = 0, commit_id = 0;
+        {
+            tnt::transaction tx(cn, 1.5);
+            stream_id = tx.stream_id();
+            tx.writer().call("fn", 1);
+            expect(srv.receive().empty());
+            commit_id = tx.commit();
+            expect(tx.is_finished());
+        }
+        auto begin = srv.receive(), call = srv.receive(), commit = srv.receive();
+        expect(fatal(!begin.empty() && !call.empty() && !commit.empty()));
+        expect(type(begin) == tnt::request_type::BEGIN && type(call) == tnt::request_type::CALL &&
+               type(commit) == tnt::request_type::COMMIT);
+        expect(stream_id != 0_ul && stream(begin) == stream_id && stream(call) == stream_id && stream(commit) == stream_id);
+        expect(fake_tnt::body(begin)[tnt::body_field::TIMEOUT].read<double>() == 1.5_d);
+        expect(fake_tnt::sync(commit) == commit_id && srv.receive().empty());
+
+        // an unfinished transaction is rolled back, each one gets its own stream
+        {
+            tnt::transaction tx(cn);
+            tx.writer().call("fn", 2);
+        }
+        begin = srv.receive(), call = srv.receive();
+        auto rollback = srv.receive();
+        expect(fatal(!rollback.empty()));
+        expect(type(rollback) == tnt::request_type::ROLLBACK);
+        expect(stream(begin) != stream_id && stream(rollback) == stream(begin) && srv.receive().empty());
+    };
+
+    "sql requests"_test = [] {
+        wtf_buffer buf;
+        uint64_t sync = 0;
+        tnt::iproto_writer w([&sync] { return ++sync; }, buf);
+        w.encode_prepare_request("SELECT * FROM t WHERE id = ?");
+        w.execute("SELECT * FROM t WHERE id = ?", 1);
+        w.execute(uint64_t(42), 2, "x");
+
+        mp_reader r(buf);
+        auto msg = r.iproto_message();
+        auto header = msg.read<mp_map_reader>();
+        expect(header[tnt::header_field::CODE].read<int>() == static_cast<int>(tnt::request_type::PREPARE));
+        expect(msg.read<mp_map_reader>()[tnt::body_field::SQL_TEXT].read<string_view>() == "SELECT * FROM t WHERE id = ?");
+
+        msg = r.iproto_message();
+        header = msg.read<mp_map_reader>();
+        expect(header[tnt::header_field::CODE].read<int>() == static_cast<int>(tnt::request_type::EXECUTE));
+        auto body = msg.read<mp_map_reader>();
+        expect(body[tnt::body_field::SQL_BIND].to_string() == "[1]");
+
+        msg = r.iproto_message();
+        header = msg.read<mp_map_reader>();
+        expect(header[tnt::header_field::SYNC].read<int>() == 3_i);
+        body = msg.read<mp_map_reader>();
+        expect(body[tnt::body_field::STMT_ID].read<int>() == 42_i);
+        expect(body[tnt::body_field::SQL_BIND].to_string() == R"([2, "x"])");
+    };
+
+    "sql_result"_test = [] {
+        wtf_buffer buf;
+        mp_writer w(buf);
+        w.begin_map(2);
+        w << static_cast<int>(tnt::response_field::IPROTO_METADATA);
+        w.begin_array(5);
+        for (auto [name, type]: {pair{"ID", "integer"}, {"NAME", "string"}, {"SCORE", "number"},
+                                 {"OK", "boolean"}, {"X", "scalar"}})
+            w << map<int, string>{{tnt::SQL_FIELD_NAME, name}, {tnt::SQL_FIELD_TYPE, type}};
+        w.finalize();
+        w << static_cast<int>(tnt::response_field::IPROTO_DATA);
+        w.begin_array(2);
+        w << make_tuple(1, "a", 1.5, true, nullptr) << make_tuple(-2, nullptr, 3, false, vector<int>{1});
+        w.finalize();
+        w.finalize();
+
+        tnt::sql_metadata_cache cache;
+        tnt::sql_result res(mp_plain(buf), cache);
+        expect(res.has_rows() && res.size() == 2_ul && res.metadata().column("SCORE") == 2u);
+        expect(res.metadata().columns()[1].kind == tnt::sql_type::string);
+
+        auto rows = res.rows<tuple<int, optional<string>, mp_none<>, bool, mp_none<>>>();
+        expect(rows.size() == 2_ul && get<0>(rows[1]) == -2_i && !get<1>(rows[1]) && get<1>(rows[0]) == "a");
+
+        auto cols = res.columns();
+        expect(cols.size() == 5_ul);
+        expect(cols[0].as<int64_t>() == vector<int64_t>{1, -2});
+        expect(cols[1].as<string_view>()[0] == "a" && cols[1].nulls == vector<bool>{false, true});
+        expect(cols[2].as<double>() == vector<double>{1.5, 3.0});
+        expect(cols[3].as<bool>() == vector<bool>{true, false});
+        expect(cols[4].nulls[0] && mp_reader(cols[4].as<mp_plain>()[1]).to_string() == "[1]");
+
+        tnt::sql_result again(mp_plain(buf), cache);
+        expect(cache.size() == 1_ul && &again.metadata() == &res.metadata());
+    };
+
+    "sql_result wide integers"_test = [] {
+        auto integers = [](wtf_buffer &buf, auto... rows) {
+            mp_writer w(buf);
+            w.begin_map(2);
+            w << static_cast<int>(tnt::response_field::IPROTO_METADATA);
+            w << vector{map<int, string>{{tnt::SQL_FIELD_NAME, "N"}, {tnt::SQL_FIELD_TYPE, "integer"}}};
+            w << static_cast<int>(tnt::response_field::IPROTO_DATA);
+            w << vector{make_tuple(rows)...};
+            w.finalize();
+            return tnt::sql_result(mp_plain(buf)).columns().front();
+        };
+        const uint64_t big = 18000000000000000000u;
+
+        wtf_buffer b1, b2, b3;
+        auto col = integers(b1, optional<int64_t>{1}, optional<int64_t>{-2});
+        expect(col.kind == tnt::sql_type::integer && col.as<int64_t>() == vector<int64_t>{1, -2});
+
+        col = integers(b2, optional<uint64_t>{1}, optional<uint64_t>{}, optional<uint64_t>{big}, optional<uint64_t>{3});
+        expect(col.kind == tnt::sql_type::unsigned_integer);
+        expect(col.as<uint64_t>() == vector<uint64_t>{1, 0, big, 3} && col.nulls == vector<bool>{false, true, false, false});
+
+        // negative values along with ones above INT64_MAX are left as is
+        wtf_buffer negative, wide;
+        mp_writer(negative) << -1;
+        mp_writer(wide) << big;
+        col = integers(b3, mp_plain(negative), mp_plain(wide), mp_plain(negative));
+        expect(col.kind == tnt::sql_type::any && col.size() == 3_ul && !col.nulls[1]);
+        expect(mp_reader(col.as<mp_plain>()[0]).read<int64_t>() == -1_ll);
+        expect(mp_reader(col.as<mp_plain>()[1]).read<uint64_t>() == big);
+    };
+
+    "stream requests"_test = [] {
+        wtf_buffer b1, b2;
+        uint64_t s1 = 0, s2 = 0;
+        tnt::iproto_writer w1([&s1] { return ++s1; }, b1), w2([&s2] { return ++s2; }, b2);
+        w1.set_stream_id(7);
+        w1.encode_begin_request(1.5, tnt::txn_isolation::READ_COMMITTED);
+        w1.call("fn", 1);
+        w1.static_call<"fn">(1);
+        w1.encode_commit_request();
+
+        mp_reader r(b1);
+        auto msg = r.iproto_message();
+        auto header = msg.read<mp_map_reader>();
+        expect(header[tnt::header_field::CODE].read<int>() == static_cast<int>(tnt::request_type::BEGIN));
+        expect(header[tnt::header_field::STREAM_ID].read<int>() == 7_i);
+        auto body = msg.read<mp_map_reader>();
+        expect(body[tnt::body_field::TIMEOUT].read<double>() == 1.5_d);
+        expect(body[tnt::body_field::TXN_ISOLATION].read<int>() == static_cast<int>(tnt::txn_isolation::READ_COMMITTED));
+
+        auto call = r.iproto_message(), static_call = r.iproto_message();
+        expect(call.size() == static_call.size());
+        expect(call.read<mp_map_reader>()[tnt::header_field::STREAM_ID].read<int>() == 7_i);
+        header = static_call.read<mp_map_reader>();
+        expect(header[tnt::header_field::SYNC].read<int>() == 3_i && header[tnt::header_field::STREAM_ID].read<int>() == 7_i);
+        expect(std::equal(call.pos(), call.end(), static_call.pos())); // the same body
+
+        msg = r.iproto_message();
+        expect(msg.read<mp_map_reader>()[tnt::header_field::CODE].read<int>() == static_cast<int>(tnt::request_type::COMMIT));
+
+        w2.call("fn", 1);
+        expect(mp_reader(b2).iproto_message().read<mp_map_reader>().cardinality() == 2_ul); // CODE and SYNC only
+    };
+
+    "watch requests"_test = [] {
+        wtf_buffer buf;
+        uint64_t sync = 0;
+        tnt::iproto_writer w([&sync] { return ++sync; }, buf);
+        w.encode_watch_request("box.status");
+        w.encode_unwatch_request("box.status");
+        w.encode_watch_once_request("config");
+
+        mp_reader r(buf);
+        for (auto [type, key]: {pair{tnt::request_type::WATCH, "box.status"},
+                                {tnt::request_type::UNWATCH, "box.status"},
+                                {tnt::request_type::WATCH_ONCE, "config"}})
+        {
+            auto msg = r.iproto_message();
+            expect(msg.read<mp_map_reader>()[tnt::header_field::CODE].read<int>() == static_cast<int>(type));
+            auto body = msg.read<mp_map_reader>();
+            expect(body.cardinality() == 1_ul && body[tnt::subscription_field::EVENT_KEY].read<string_view>() == key);
+        }
+    };
+
+    "connection watchers"_test = [] {
+        auto type = [](const vector<char> &request) { return static_cast<tnt::request_type>(fake_tnt::code(request)); };
+        auto key = [](const vector<char> &request) {
+            return string(fake_tnt::body(request)[tnt::subscription_field::EVENT_KEY].read<string_view>());
+        };
+        {
+            fake_tnt srv;
+            tnt::connection cn;
+            srv.handshake(cn, {3});
+            size_t responses = 0;
+            cn.on_response([&responses](wtf_buffer &) { ++responses; });
+            vector<string> events;
+            cn.watch("box.status", [&events](string_view, mp_plain data) {
+                events.push_back(mp_reader(data).to_string());
+            });
+            auto watch = srv.receive();
+            expect(fatal(!watch.empty()));
+            expect(type(watch) == tnt::request_type::WATCH && key(watch) == "box.status");
+
+            // the event is consumed by the connector and acknowledged
+            srv.message(static_cast<uint32_t>(tnt::request_type::EVENT), 0, 1, [](mp_writer &w) {
+                w.begin_map(2);
+                w << static_cast<int>(tnt::subscription_field::EVENT_KEY) << "box.status"
+                  << static_cast<int>(tnt::subscription_field::EVENT_DATA) << map<string, string>{{"status", "running"}};
+                w.finalize();
+            });
+            srv.send(cn);
+            expect(events == vector<string>{R"({"status": "running"})"} && responses == 0_ul);
+            auto ack = srv.receive();
+            expect(fatal(!ack.empty()));
+            expect(type(ack) == tnt::request_type::WATCH && key(ack) == "box.status");
+
+            cn.unwatch("box.status");
+            auto unwatch = srv.receive();
+            expect(fatal(!unwatch.empty()));
+            expect(type(unwatch) == tnt::request_type::UNWATCH && key(unwatch) == "box.status");
+        }
+
+        // nothing is sent to a server without the feature
+        fake_tnt srv;
+        tnt::connection cn;
+        vector<tnt::error> errors;
+        cn.on_error([&errors](string_view, tnt::error code, uint32_t) { errors.push_back(code); });
+        cn.watch("box.status", [](string_view, mp_plain) {});
+        srv.handshake(cn);
+        cn.watch("box.id", [](string_view, mp_plain) {});
+        cn.unwatch("box.status");
+        expect(srv.receive().empty());
+        expect(errors == vector<tnt::error>{tnt::error::features, tnt::error::features});
+    };
+
     scope s = run_loop();
     bool connected = open_tnt_connection(argc > 1 ? argv[1] : "localhost:3301");
     if (!connected)
@@ -294,6 +1425,127 @@ return
                 cn.flush();
             });
         };
+
+        should("schema cache") = []{
+            sync_tnt_request([](tnt::connection &cn)
+            {
+                cn.set_schema_caching(true); // catalog requests go first
+                tnt::iproto_writer w([&cn](){ return cn.next_request_id();}, cn.output_buffer());
+                w.eval("box.schema.space.create('cpp2tnt_test', {if_not_exists = true}):"
+                       "create_index('pk', {if_not_exists = true})");
+                set_handler(cn.last_request_id(), [](const mp_map_reader &header, const mp_map_reader &body) {
+                    expect(ut::nothrow([&](){ throw_if_error(header, body); }));
+                    return true;
+                });
+                cn.flush();
+            });
+            // the response to DDL reports a new schema version, so the catalog is reloaded
+            sync_tnt_request([](tnt::connection &cn)
+            {
+                tnt::iproto_writer w([&cn](){ return cn.next_request_id();}, cn.output_buffer());
+                w.encode_ping_request();
+                set_handler(cn.last_request_id(), [](const mp_map_reader &header, const mp_map_reader &body) {
+                    expect(ut::nothrow([&](){ throw_if_error(header, body); }));
+                    return true;
+                });
+                cn.flush();
+            });
+            sync_tnt_request([](tnt::connection &cn)
+            {
+                const auto &sc = cn.schema();
+                bool loaded = sc.space_id("_vspace") == tnt::VSPACE_ID && sc.index_id("cpp2tnt_test", "pk") == 0u;
+                tnt::iproto_writer w([&cn](){ return cn.next_request_id();}, cn.output_buffer());
+                w.encode_select_request(sc, "cpp2tnt_test", "pk");
+                set_handler(cn.last_request_id(), [loaded](const mp_map_reader &header, const mp_map_reader &body) {
+                    expect(loaded);
+                    expect(ut::nothrow([&](){ throw_if_error(header, body); }));
+                    return true;
+                });
+                w.eval("box.space.cpp2tnt_test:drop()");
+                set_handler(cn.last_request_id(), [](const mp_map_reader &header, const mp_map_reader &body) {
+                    expect(ut::nothrow([&](){ throw_if_error(header, body); }));
+                    return true;
+                });
+                cn.flush();
+            });
+        };
+
+        should("prepared statements") = []{
+            static const string sql = "SELECT ? + 1 AS \"X\"";
+            sync_tnt_request([](tnt::connection &cn)
+            {
+                cn.execute(sql, 1);
+                set_handler(cn.last_request_id(), [](const mp_map_reader &header, const mp_map_reader &body) {
+                    expect(ut::nothrow([&](){ throw_if_error(header, body); }));
+                    expect(body[tnt::IPROTO_DATA].to_string() == "[[2]]");
+                    return true;
+                });
+                cn.flush();
+            });
+            sync_tnt_request([](tnt::connection &cn)
+            {
+                // prepared by now, so it goes by id
+                const tnt::prepared_statement *st = cn.statement(sql);
+                bool prepared = st && st->id && st->bind_count == 1 && !st->metadata.empty();
+                cn.execute(sql, 41);
+                set_handler(cn.last_request_id(), [prepared](const mp_map_reader &header, const mp_map_reader &body) {
+                    expect(prepared);
+                    expect(ut::nothrow([&](){ throw_if_error(header, body); }));
+                    expect(body[tnt::IPROTO_DATA].to_string() == "[[42]]");
+                    return true;
+                });
+                cn.flush();
+            });
+        };
+
+        should("transaction") = []{
+            sync_tnt_request([](tnt::connection &cn)
+            {
+                auto ok = [](const mp_map_reader &header, const mp_map_reader &body) {
+                    expect(ut::nothrow([&](){ throw_if_error(header, body); }));
+                    return true;
+                };
+                tnt::transaction tx(cn);
+                set_handler(tx.begin_id(), ok);
+                tx.writer().eval("return box.is_in_txn()");
+                set_handler(cn.last_request_id(), [](const mp_map_reader &header, const mp_map_reader &body) {
+                    expect(ut::nothrow([&](){ throw_if_error(header, body); }));
+                    expect(body[tnt::IPROTO_DATA].to_string() == "[true]");
+                    return true;
+                });
+                set_handler(tx.commit(), ok);
+            });
+        };
+
+        should("watch") = []{
+            static vector<string> events;
+            sync_tnt_request([](tnt::connection &cn)
+            {
+                cn.watch("cpp2tnt_test", [](string_view, mp_plain data) {
+                    events.push_back(data.begin == data.end ? "" : mp_reader(data).to_string());
+                });
+                // the current value comes first, the broadcast one after the acknowledgement
+                tnt::iproto_writer w([&cn](){ return cn.next_request_id();}, cn.output_buffer());
+                w.eval("box.broadcast('cpp2tnt_test', 42) require('fiber').sleep(0.1)");
+                set_handler(cn.last_request_id(), [](const mp_map_reader &header, const mp_map_reader &body) {
+                    expect(ut::nothrow([&](){ throw_if_error(header, body); }));
+                    expect(!events.empty() && events.back() == "42");
+                    return true;
+                });
+                cn.flush();
+            });
+            sync_tnt_request([](tnt::connection &cn)
+            {
+                cn.unwatch("cpp2tnt_test");
+                tnt::iproto_writer w([&cn](){ return cn.next_request_id();}, cn.output_buffer());
+                w.eval("box.broadcast('cpp2tnt_test', nil)");
+                set_handler(cn.last_request_id(), [](const mp_map_reader &header, const mp_map_reader &body) {
+                    expect(ut::nothrow([&](){ throw_if_error(header, body); }));
+                    return true;
+                });
+                cn.flush();
+            });
+        };
     };
 
     return EXIT_SUCCESS;
@@ -0,0 +1,49 @@
+#include "transaction.h"
+#include "connection.h"
+
+using namespace std;
+
+/// Tarantool connector scope
+namespace tnt
+{
+
+transaction::transaction(connection &cn, double timeout, txn_isolation isolation)
+    : _cn(cn), _writer([&cn]() { return cn.next_request_id(); }, cn.output_buffer())
+{
+    _writer.set_stream_id(cn.next_stream_id());
+    _writer.encode_begin_request(timeout, isolation);
+    _begin_id = cn.last_request_id();
+}
+
+transaction::~transaction()
+{
+    if (_finished)
+        return;
+    try
+    {
+        rollback();
+    }
+    catch (...) {}
+}
+
+uint64_t transaction::commit()
+{
+    if (_finished)
+        throw runtime_error("transaction is already finished");
+    _writer.encode_commit_request();
+    _finished = true;
+    _cn.flush();
+    return _cn.last_request_id();
+}
+
+uint64_t transaction::rollback()
+{
+    if (_finished)
+        throw runtime_error("transaction is already finished");
+    _writer.encode_rollback_request();
+    _finished = true;
+    _cn.flush();
+    return _cn.last_request_id();
+}
+
+} // namespace tnt
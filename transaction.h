@@ -0,0 +1,78 @@
+#ifndef TNT_TRANSACTION_H
+#define TNT_TRANSACTION_H
+
+/** @file */
+
+#include <cstdint>
+#include "iproto.h"
+#include "iproto_writer.h"
+
+/// Tarantool connector scope
+namespace tnt
+{
+
+class connection;
+
+/** Interactive transaction within a dedicated iproto stream.
+ *
+ *  BEGIN, the operations and COMMIT are put into the output buffer and sent
+ *  with a single flush, so the whole transaction takes one round trip.
+ *  The connection must request the features: `cn.set_required_proto({feature::STREAMS,
+ *  feature::TRANSACTIONS, feature::ERROR_EXTENSION}, 1, "chap-sha1")`.
+ *
+ *  \code
+ *  tnt::transaction tx(cn);
+ *  tx.writer().encode_replace_request(512, std::make_tuple(1, "a"));
+ *  tx.writer().call("fn", 2);
+ *  uint64_t sync = tx.commit();
+ *  \endcode
+ *
+ *  Responses come in the order of requests. A transaction left unfinished
+ *  is rolled back on destruction.
+ */
+class transaction
+{
+public:
+    /// Start a transaction (timeout in seconds, 0 - box.cfg.txn_timeout).
+    explicit transaction(connection &cn, double timeout = 0, txn_isolation isolation = txn_isolation::DEFAULT);
+    ~transaction();
+    transaction(const transaction&) = delete;
+    transaction& operator=(const transaction&) = delete;
+
+    /// Writer to put the operations with (bound to the stream and the output buffer).
+    iproto_writer& writer() noexcept
+    {
+        return _writer;
+    }
+
+    uint64_t stream_id() const noexcept
+    {
+        return _writer.stream_id();
+    }
+
+    /// Request id (sync) of BEGIN.
+    uint64_t begin_id() const noexcept
+    {
+        return _begin_id;
+    }
+
+    bool is_finished() const noexcept
+    {
+        return _finished;
+    }
+
+    /// Put COMMIT and flush the connection. \return request id (sync) of COMMIT
+    uint64_t commit();
+    /// Put ROLLBACK and flush the connection. \return request id (sync) of ROLLBACK
+    uint64_t rollback();
+
+private:
+    connection &_cn;
+    iproto_writer _writer;
+    uint64_t _begin_id;
+    bool _finished = false;
+};
+
+} // namespace tnt
+
+#endif // TNT_TRANSACTION_H